@@ -27,14 +27,23 @@
 #include <boost/bind.hpp>
 #include <boost/interprocess/ipc/message_queue.hpp>
 
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
 
 namespace kinect{
 
+  // only 8 image units are guaranteed, the reconstructions rebind theirs before use
+  static int image_unit_depth = 0;
+  static int image_unit_quality = 1;
+  static int image_unit_normal = 2;
+  static unsigned storage_binding_filter_error = 12;
+
   NetKinectArray::NetKinectArray(std::string const& serverport, CalibrationFiles const* calibs, CalibVolumes const* vols, bool readfromfile)
     : m_width(0),
       m_widthc(0),
@@ -50,6 +59,8 @@ namespace kinect{
       m_depthArray_back(0),
       m_program_filter{new globjects::Program()},
       m_program_normal{new globjects::Program()},
+      m_program_process{new globjects::Program()},
+      m_buffer_filter_error{new globjects::Buffer()},
       m_colorsize(0),
       m_depthsize(0),
       m_pbo_colors(),
@@ -58,6 +69,9 @@ namespace kinect{
       m_readThread(0),
       m_running(true),
       m_filter_textures(true),
+      m_compute_processing(true),
+      m_separable_filter(false),
+      m_timer_stages(),
       m_serverport(serverport),
       m_start_texture_unit(0),
       m_calib_files{calibs},
@@ -82,6 +96,34 @@ namespace kinect{
      globjects::Shader::fromFile(GL_VERTEX_SHADER,   "glsl/texture_passthrough.vs")
     ,globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "glsl/normal_computation.fs")
     );
+    m_program_process->attach(
+     globjects::Shader::fromFile(GL_COMPUTE_SHADER, "glsl/depth_process.cs")
+    );
+    GLint max_image_units = 0;
+    glGetIntegerv(GL_MAX_IMAGE_UNITS, &max_image_units);
+    if (image_unit_normal >= max_image_units) {
+      throw std::runtime_error{"depth processing needs " + std::to_string(image_unit_normal + 1) + " image units, "
+                               + std::to_string(max_image_units) + " available"};
+    }
+    m_program_process->setUniform("kinect_depths", 40);
+    m_program_process->setUniform("res_depth", glm::uvec2{m_width, m_height});
+    m_program_process->setUniform("out_depth", image_unit_depth);
+    m_program_process->setUniform("out_quality", image_unit_quality);
+    m_program_process->setUniform("out_normal", image_unit_normal);
+    std::vector<unsigned> compress(5, 0);
+    std::vector<float> scales(5, 0.0f);
+    std::vector<float> nears(5, 0.0f);
+    for(unsigned i = 0; i < m_calib_files->num(); ++i){
+      compress[i] = m_calib_files->getCalibs()[i].isCompressedDepth();
+      nears[i] = m_calib_files->getCalibs()[i].getNear();
+      scales[i] = m_calib_files->getCalibs()[i].getFar() - nears[i];
+    }
+    m_program_process->setUniform("compress", compress);
+    m_program_process->setUniform("scale", scales);
+    m_program_process->setUniform("near", nears);
+    m_program_process->setUniform("separable", m_separable_filter);
+    m_program_process->setUniform("compare", false);
+    m_buffer_filter_error->setData(5 * sizeof(unsigned), nullptr, GL_DYNAMIC_READ);
   }
 
   bool
@@ -132,17 +174,13 @@ namespace kinect{
     }
     m_colorArray_back = new mvt::TextureArray(m_widthc, m_heightc, m_numLayers, GL_RGB, GL_RGB, GL_UNSIGNED_BYTE);
 
-    m_textures_quality->image3D(0, GL_LUMINANCE32F_ARB, m_width, m_height, m_numLayers, 0, GL_RED, GL_FLOAT, (void*)nullptr);
-    m_textures_normal->image3D(0, GL_RGB32F, m_width, m_height, m_numLayers, 0, GL_RGB, GL_FLOAT, (void*)nullptr);
+    // processing outputs, in formats which can be bound as images
+    m_textures_quality->image3D(0, GL_R32F, m_width, m_height, m_numLayers, 0, GL_RED, GL_FLOAT, (void*)nullptr);
+    m_textures_normal->image3D(0, GL_RGBA32F, m_width, m_height, m_numLayers, 0, GL_RGBA, GL_FLOAT, (void*)nullptr);
 
     m_depthArray = new mvt::TextureArray(m_width, m_height, m_numLayers, GL_LUMINANCE32F_ARB, GL_RED, GL_FLOAT);
 
-    if(m_calib_files->isCompressedDepth()){
-      m_depthArray_back = new mvt::TextureArray(m_width, m_height, m_numLayers, GL_LUMINANCE, GL_RED, GL_UNSIGNED_BYTE);
-    }
-    else{
-      m_depthArray_back = new mvt::TextureArray(m_width, m_height, m_numLayers, GL_LUMINANCE32F_ARB, GL_RED, GL_FLOAT);
-    }
+    m_depthArray_back = new mvt::TextureArray(m_width, m_height, m_numLayers, GL_R32F, GL_RED, GL_FLOAT);
     m_depthArray->setMAGMINFilter(GL_NEAREST);
     m_depthArray_back->setMAGMINFilter(GL_NEAREST);
 
@@ -171,6 +209,8 @@ namespace kinect{
     m_textures_normal->destroy();
     m_program_filter->destroy();
     m_program_normal->destroy();
+    m_program_process->destroy();
+    m_buffer_filter_error->destroy();
   }
 
   void
@@ -196,6 +236,42 @@ glm::uvec2 NetKinectArray::getColorResolution() const {
 }
 void
 NetKinectArray::processTextures(){
+  if(m_compute_processing){
+    std::string stage{m_separable_filter ? "process compute separable" : "process compute"};
+    m_timer_stages.start(stage);
+    processTexturesCompute();
+    m_timer_stages.stop(stage);
+  }
+  else{
+    m_timer_stages.start("process fragment");
+    processTexturesFragment();
+    m_timer_stages.stop("process fragment");
+  }
+}
+
+void
+NetKinectArray::processTexturesCompute(){
+  glActiveTexture(GL_TEXTURE0 + 40);
+  m_depthArray->bind();
+
+  m_depthArray_back->getTexture()->bindImageTexture(image_unit_depth, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+  m_textures_quality->bindImageTexture(image_unit_quality, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+  m_textures_normal->bindImageTexture(image_unit_normal, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+  m_program_process->setUniform("filter_textures", m_filter_textures);
+  m_buffer_filter_error->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_filter_error);
+  m_program_process->setUniform("cv_xyz", m_calib_vols->getXYZVolumeUnits());
+  m_calib_vols->setDecodeUniforms(m_program_process);
+
+  m_program_process->use();
+  m_program_process->dispatchCompute((m_width + 15) / 16, (m_height + 15) / 16, m_numLayers);
+  m_program_process->release();
+
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void
+NetKinectArray::processTexturesFragment(){
 
   glPushAttrib(GL_ALL_ATTRIB_BITS);
 
@@ -237,6 +313,7 @@ NetKinectArray::processTextures(){
   m_program_normal->use();
   m_program_normal->setUniform("cv_xyz", m_calib_vols->getXYZVolumeUnits());
   m_program_normal->setUniform("cv_uv", m_calib_vols->getUVVolumeUnits());
+  m_calib_vols->setDecodeUniforms(m_program_normal);
   m_program_normal->setUniform("kinect_depths", GLint(m_start_texture_unit + 1));
 
   m_fbo->setDrawBuffers({GL_COLOR_ATTACHMENT2});
@@ -282,6 +359,48 @@ unsigned NetKinectArray::getStartTextureUnit() const {
   return m_start_texture_unit;
 }
 
+void NetKinectArray::setComputeProcessing(bool enable) {
+  m_compute_processing = enable;
+  processTextures();
+}
+
+bool NetKinectArray::isComputeProcessing() const {
+  return m_compute_processing;
+}
+
+void NetKinectArray::setSeparableFilter(bool enable) {
+  m_separable_filter = enable;
+  m_program_process->setUniform("separable", m_separable_filter);
+  processTextures();
+}
+
+bool NetKinectArray::isSeparableFilter() const {
+  return m_separable_filter;
+}
+
+FilterError NetKinectArray::measureFilterError() {
+  std::array<unsigned, 5> stats{{0, 0, 0, 0, 0}};
+  m_buffer_filter_error->setSubData(0, sizeof(stats), stats.data());
+  m_program_process->setUniform("compare", true);
+  processTexturesCompute();
+  m_program_process->setUniform("compare", false);
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  stats = m_buffer_filter_error->getSubData<unsigned, 5>();
+
+  // errors are accumulated in 0.1mm
+  FilterError error{};
+  float num_valid = float(std::max(stats[0], 1u));
+  error.mean_depth = stats[2] * 1e-4f / num_valid;
+  error.max_depth = stats[3] * 1e-4f;
+  error.mean_quality = stats[4] * 1e-4f / num_valid;
+  error.mismatch_ratio = float(stats[1]) / float(std::max(stats[0] + stats[1], 1u));
+  return error;
+}
+
+std::vector<std::pair<std::string, double>> const& NetKinectArray::getStageTimes() {
+  return m_timer_stages.get();
+}
+
 void NetKinectArray::filterTextures(bool filter) {
   m_filter_textures = filter;
   // process with new settings
@@ -17,6 +17,7 @@ using namespace gl;
 #include <globjects/Texture.h>
 #include <globjects/Framebuffer.h>
 #include <globjects/Buffer.h>
+#include <GPUStageTimer.h>
 
 namespace boost{
   class thread;
@@ -114,6 +115,16 @@ inline void swap(double_pbo& a, double_pbo& b) {
   a.swap(b);
 }
 
+  // difference of the separable approximation to the full bilateral filter
+  struct FilterError {
+    // in m, over the pixels valid with both filters
+    float mean_depth;
+    float max_depth;
+    float mean_quality;
+    // pixels valid with only one of the filters, relative to the pixels valid with any
+    float mismatch_ratio;
+  };
+
   class KinectCalibrationFile;
   class CalibrationFiles;
   class CalibVolumes;
@@ -145,6 +156,17 @@ inline void swap(double_pbo& a, double_pbo& b) {
 
     void filterTextures(bool filter);
 
+    // one compute dispatch for filtering and normals instead of two fragment passes per camera
+    void setComputeProcessing(bool enable);
+    bool isComputeProcessing() const;
+    // separable bilateral approximation in the compute path, 26 instead of 169 taps per pixel
+    void setSeparableFilter(bool enable);
+    bool isSeparableFilter() const;
+    // compares both filters on the current frame, waits for the result
+    FilterError measureFilterError();
+    // gpu time in ms of the processing paths, from the latest finished frame
+    std::vector<std::pair<std::string, double>> const& getStageTimes();
+
     void bindToTextureUnits() const;
 
     glm::uvec2 getDepthResolution() const;
@@ -153,6 +175,9 @@ inline void swap(double_pbo& a, double_pbo& b) {
   protected:
     void bindToFramebuffer(GLuint array_handle, GLuint layer);
 
+    void processTexturesFragment();
+    void processTexturesCompute();
+
 
     void readLoop();
     void readFromFiles();
@@ -173,6 +198,8 @@ inline void swap(double_pbo& a, double_pbo& b) {
 
     globjects::Program* m_program_filter;
     globjects::Program* m_program_normal;
+    globjects::Program* m_program_process;
+    globjects::Buffer*  m_buffer_filter_error;
 
     unsigned m_colorsize; // per frame
     unsigned m_depthsize; // per frame
@@ -183,6 +210,9 @@ inline void swap(double_pbo& a, double_pbo& b) {
     boost::thread* m_readThread;
     bool m_running;
     bool m_filter_textures;
+    bool m_compute_processing;
+    bool m_separable_filter;
+    sensor::GPUStageTimer m_timer_stages;
     std::string m_serverport;
 
     unsigned m_start_texture_unit;
@@ -1,44 +1,89 @@
 #include "CalibVolumes.hpp"
+#include "calibration_files.hpp"
+#include "validity_volume.hpp"
 #include <KinectCalibrationFile.h>
 #include <timevalue.h>
+#include <Timer.h>
 
 #include <glbinding/gl/functions-patches.h>
 #include <globjects/Shader.h>
+#include <globjects/UniformBlock.h>
+#include <globjects/NamedString.h>
+#include <globjects/base/File.h>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/norm.hpp>
 
+#include <fstream>
 #include <stdexcept>
 
 namespace kinect{
 
 static glm::uvec3 volume_res{128,256,128};
 static int start_image_unit = 1;
+static unsigned uniform_binding_models = 1;
 
-CalibVolumes::CalibVolumes(std::vector<std::string> const& calib_volume_files, gloost::BoundingBox const& bbox)
+CalibVolumes::CalibVolumes(CalibrationFiles const& cfs, gloost::BoundingBox const& bbox, VolumeEncoding encoding)
  :m_cv_xyz_filenames()
  ,m_cv_uv_filenames()
  ,m_volumes_xyz{}
  ,m_volumes_uv{}
  ,m_volumes_xyz_inv{}
+ ,m_data_volume_valid{}
+ ,m_volume_valid{nullptr}
  ,m_frustums{}
  ,m_bbox{bbox}
+ ,m_encoding{encoding}
+ ,m_intrinsics{}
+ ,m_models_xyz{}
+ ,m_models_uv{}
+ ,m_scales_xyz{}
+ ,m_scales_uv{}
+ ,m_analytic_xyz{}
+ ,m_analytic_uv{}
+ ,m_grids_xyz{}
+ ,m_grids_uv{}
+ ,m_buffer_models{new globjects::Buffer()}
+ ,m_analytic{false}
  ,m_start_texture_unit(-1)
  ,m_start_texture_unit_inv(-1)
+ ,m_start_texture_unit_grid(-1)
 {
-  for(auto const& calib_file : calib_volume_files){
+  for(auto const& calib_file : cfs.getFileNames()){
   	std::string basefile = calib_file;
   	basefile.replace( basefile.end() - 3, basefile.end(), "");
   	m_cv_xyz_filenames.push_back(basefile + "cv_xyz");
   	m_cv_uv_filenames.push_back(basefile + "cv_uv");
   }
+  // depth intrinsics normalized to texture coordinates
+  glm::fvec2 depth_res{float(cfs.getWidth()), float(cfs.getHeight())};
+  for(auto const& calib : cfs.getCalibs()){
+    glm::fvec4 intrinsics{calib.getDepthIntrinsics()};
+    m_intrinsics.emplace_back(intrinsics.x / depth_res.x, intrinsics.y / depth_res.y,
+                              (intrinsics.z + 0.5f) / depth_res.x, (intrinsics.w + 0.5f) / depth_res.y);
+  }
 
-  for(unsigned i = 0; i < m_cv_xyz_filenames.size(); ++i){
-    addVolume(m_cv_xyz_filenames[i], m_cv_uv_filenames[i]);
+  loadVolumes();
+
+  sensor::Timer timer{};
+  timer.start();
+  if (m_encoding == VolumeEncoding::FLOAT) {
+    createVolumeTextures();
   }
+  else {
+    createEncodedVolumeTextures();
+  }
+  timer.stop();
+  std::cout << "creating volume textures took " << timer.get().msec() << " ms" << std::endl;
+
+  loadAnalyticModels();
+  updateModelBuffer();
 
-  createVolumeTextures();
+  // shaders share the decoding through #include "/calib_decode.glsl"
+  if (!globjects::NamedString::isNamedString("/calib_decode.glsl")) {
+    globjects::NamedString::create("/calib_decode.glsl", new globjects::File("glsl/calib_decode.glsl", false));
+  }
 }
 
 CalibVolumes::~CalibVolumes(){
@@ -49,24 +94,74 @@ CalibVolumes::~CalibVolumes(){
   for(unsigned i = 0; i < m_volumes_xyz_inv.size(); ++i){
     m_volumes_xyz_inv[i]->destroy();
   }
+  if (m_volume_valid) {
+    m_volume_valid->destroy();
+  }
+  for(unsigned i = 0; i < m_grids_xyz.size(); ++i){
+    m_grids_xyz[i]->destroy();
+    m_grids_uv[i]->destroy();
+  }
+  m_buffer_models->destroy();
 }
 
 void CalibVolumes::loadInverseCalibs(std::string const& path) {
-  for (unsigned i = 0; i < m_cv_xyz_filenames.size(); ++i){
+  sensor::Timer timer{};
+  timer.start();
+  m_data_volumes_xyz_inv.resize(m_cv_xyz_filenames.size());
+  #pragma omp parallel for
+  for (int i = 0; i < int(m_cv_xyz_filenames.size()); ++i){
     std::string name_source{m_cv_xyz_filenames[i].substr( m_cv_xyz_filenames[i].find_last_of("/\\") + 1)};
-    std::string name_input{path + name_source + "_inv"};
-    std::cout << "loading " << name_input << std::endl;
-    m_data_volumes_xyz_inv.emplace_back(name_input);
-    auto const& calib(m_data_volumes_xyz_inv.back());
-    std::cout << "dimensions xyz - " << calib.res().x << ", " << calib.res().y << ", " << calib.res().z 
+    m_data_volumes_xyz_inv[i] = CalibrationVolume<glm::fvec4>{path + name_source + "_inv"};
+  }
+  // encode on the workers as well, only the upload needs the context
+  std::vector<std::vector<std::int16_t>> encoded_inv(m_data_volumes_xyz_inv.size());
+  std::vector<float> max_errors(m_data_volumes_xyz_inv.size(), 0.0f);
+  if (m_encoding != VolumeEncoding::FLOAT) {
+    #pragma omp parallel for
+    for (int i = 0; i < int(m_data_volumes_xyz_inv.size()); ++i){
+      encoded_inv[i] = encodeInverseVolume(m_data_volumes_xyz_inv[i].volume(), max_errors[i]);
+    }
+  }
+  // masks are written by calib_inverter, missing or stale ones are recomputed
+  glm::uvec3 res_inv{m_data_volumes_xyz_inv[0].res()};
+  if (!readValidityVolume(path + "cv_valid", m_bbox, m_frustums.size(), res_inv, m_data_volume_valid)) {
+    std::cout << "computing validity volume" << std::endl;
+    m_data_volume_valid = computeValidityVolume(m_frustums, m_bbox, res_inv);
+  }
+  timer.stop();
+  for (auto const& calib : m_data_volumes_xyz_inv) {
+    std::cout << "dimensions xyz inv - " << calib.res().x << ", " << calib.res().y << ", " << calib.res().z 
               << " minmax d - " << calib.depthLimits().x << ", " << calib.depthLimits().y << std::endl;
   }
+  std::cout << "loading inverse volumes took " << timer.get().msec() << " ms" << std::endl;
 
-  for (auto const& calib : m_data_volumes_xyz_inv) {
+  timer.start();
+  for (unsigned i = 0; i < m_data_volumes_xyz_inv.size(); ++i) {
+    auto const& calib = m_data_volumes_xyz_inv[i];
     auto volume_xyz_inv = globjects::Texture::createDefault(GL_TEXTURE_3D);
-    volume_xyz_inv->image3D(0, GL_RGBA32F, glm::ivec3{calib.res()}, 0, GL_RGBA, GL_FLOAT, calib.volume().data());
+    if (m_encoding == VolumeEncoding::FLOAT) {
+      volume_xyz_inv->image3D(0, GL_RGBA32F, glm::ivec3{calib.res()}, 0, GL_RGBA, GL_FLOAT, calib.volume().data());
+    }
+    else {
+      // coordinates are normalized, invalid voxels stay negative
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+      volume_xyz_inv->image3D(0, GL_RGB16_SNORM, glm::ivec3{calib.res()}, 0, GL_RGB, GL_SHORT, encoded_inv[i].data());
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      std::cout << "inverse volume snorm16 - max error " << max_errors[i]
+                << ", " << calib.numVoxels() * 16 / 1048576.0f << " MB -> " << encoded_inv[i].size() * 2 / 1048576.0f << " MB"
+                << ", lookup 128 B -> 48 B" << std::endl;
+    }
     m_volumes_xyz_inv.emplace_back(volume_xyz_inv);
   }
+  m_volume_valid = globjects::Texture::createDefault(GL_TEXTURE_3D);
+  // integer textures are incomplete with linear filtering
+  m_volume_valid->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  m_volume_valid->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  m_volume_valid->image3D(0, GL_R8UI, glm::ivec3{res_inv}, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, m_data_volume_valid.volume().data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  timer.stop();
+  std::cout << "uploading inverse volumes took " << timer.get().msec() << " ms" << std::endl;
 }
 
 std::vector<int> CalibVolumes::getXYZVolumeUnitsInv() const {
@@ -77,6 +172,11 @@ std::vector<int> CalibVolumes::getXYZVolumeUnitsInv() const {
   return units;
 }
 
+int CalibVolumes::getValidityVolumeUnit() const {
+  // behind the five inverse volume units
+  return m_start_texture_unit_inv + 5;
+}
+
 glm::uvec3 CalibVolumes::getVolumeRes() const {
   return m_data_volumes_xyz_inv[0].res();
 }
@@ -102,21 +202,32 @@ static std::array<glm::fvec3, 8> getCornerPoints(CalibrationVolume<xyz> const& c
   return points_corner;
 }
 
-void CalibVolumes::addVolume(std::string const& filename_xyz, std::string const& filename_uv) {
-  std::cout << "loading " << filename_xyz << std::endl;
-  m_data_volumes_xyz.emplace_back(filename_xyz);
-  auto const& calib_xyz(m_data_volumes_xyz.back());
-  std::cout << "dimensions xyz - " << calib_xyz.res().x << ", " << calib_xyz.res().y << ", " << calib_xyz.res().z 
-            << " minmax d - " << calib_xyz.depthLimits().x << ", " << calib_xyz.depthLimits().y << std::endl;
+void CalibVolumes::loadVolumes() {
+  sensor::Timer timer{};
+  timer.start();
+  m_data_volumes_xyz.resize(m_cv_xyz_filenames.size());
+  m_data_volumes_uv.resize(m_cv_uv_filenames.size());
+  #pragma omp parallel for
+  for(int i = 0; i < int(m_cv_xyz_filenames.size()); ++i){
+    m_data_volumes_xyz[i] = CalibrationVolume<xyz>{m_cv_xyz_filenames[i]};
+    m_data_volumes_uv[i] = CalibrationVolume<uv>{m_cv_uv_filenames[i]};
+  }
+  timer.stop();
 
-  m_frustums.emplace_back(getCornerPoints(calib_xyz));
+  for(unsigned i = 0; i < m_data_volumes_xyz.size(); ++i){
+    auto const& calib_xyz(m_data_volumes_xyz[i]);
+    std::cout << "loaded " << m_cv_xyz_filenames[i] << std::endl;
+    std::cout << "dimensions xyz - " << calib_xyz.res().x << ", " << calib_xyz.res().y << ", " << calib_xyz.res().z 
+              << " minmax d - " << calib_xyz.depthLimits().x << ", " << calib_xyz.depthLimits().y << std::endl;
 
-  std::cout << "loading " << filename_uv << std::endl;
-  m_data_volumes_uv.emplace_back(filename_uv);
-  auto const& calib_uv(m_data_volumes_uv.back());
-  std::cout << "dimensions uv - " << calib_uv.res().x << ", " << calib_uv.res().y << ", " << calib_uv.res().z 
-            << " minmax d - " << calib_uv.depthLimits().x << ", " << calib_uv.depthLimits().y << std::endl;
+    m_frustums.emplace_back(getCornerPoints(calib_xyz));
 
+    auto const& calib_uv(m_data_volumes_uv[i]);
+    std::cout << "loaded " << m_cv_uv_filenames[i] << std::endl;
+    std::cout << "dimensions uv - " << calib_uv.res().x << ", " << calib_uv.res().y << ", " << calib_uv.res().z 
+              << " minmax d - " << calib_uv.depthLimits().x << ", " << calib_uv.depthLimits().y << std::endl;
+  }
+  std::cout << "loading volumes took " << timer.get().msec() << " ms" << std::endl;
 }
 
 void CalibVolumes::createVolumeTextures() {
@@ -133,6 +244,160 @@ void CalibVolumes::createVolumeTextures() {
   }
 }
 
+static std::string toMB(std::size_t bytes) {
+  return std::to_string(bytes / 1048576.0f) + " MB";
+}
+
+void CalibVolumes::createEncodedVolumeTextures() {
+  std::vector<EncodedVolume> encoded_xyz(m_data_volumes_xyz.size());
+  std::vector<EncodedVolume> encoded_uv(m_data_volumes_uv.size());
+  sensor::Timer timer{};
+  timer.start();
+  #pragma omp parallel for
+  for(int i = 0; i < int(m_data_volumes_xyz.size()); ++i){
+    auto const& calib_xyz = m_data_volumes_xyz[i];
+    encoded_xyz[i] = encodeVolume(calib_xyz.floats(), 3, calib_xyz.res(), calib_xyz.depthLimits(), m_intrinsics[i], m_encoding);
+    auto const& calib_uv = m_data_volumes_uv[i];
+    encoded_uv[i] = encodeVolume(calib_uv.floats(), 2, calib_uv.res(), calib_uv.depthLimits(), m_intrinsics[i], m_encoding);
+  }
+  timer.stop();
+  std::cout << "encoding volumes took " << timer.get().msec() << " ms" << std::endl;
+
+  // residuals are 2 byte values, rows of RGB16 are not 4 byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+  bool half = m_encoding == VolumeEncoding::HALF;
+  for(unsigned i = 0; i < m_data_volumes_xyz.size(); ++i){
+    auto const& calib_xyz = m_data_volumes_xyz[i];
+    auto volume_xyz = globjects::Texture::createDefault(GL_TEXTURE_3D);
+    volume_xyz->image3D(0, half ? GL_RGB16F : GL_RGB16, glm::ivec3{calib_xyz.res()}, 0, GL_RGB, half ? GL_HALF_FLOAT : GL_UNSIGNED_SHORT, encoded_xyz[i].data.data());
+    m_volumes_xyz.push_back(volume_xyz);
+    m_models_xyz.push_back(encoded_xyz[i].model);
+    m_scales_xyz.emplace_back(encoded_xyz[i].scale);
+
+    auto const& calib_uv = m_data_volumes_uv[i];
+    auto volume_uv = globjects::Texture::createDefault(GL_TEXTURE_3D);
+    volume_uv->image3D(0, half ? GL_RG16F : GL_RG16, glm::ivec3{calib_uv.res()}, 0, GL_RG, half ? GL_HALF_FLOAT : GL_UNSIGNED_SHORT, encoded_uv[i].data.data());
+    m_volumes_uv.push_back(volume_uv);
+    m_models_uv.push_back(encoded_uv[i].model);
+    m_scales_uv.emplace_back(encoded_uv[i].scale);
+    // model is multilinear in the lookup coords, so the voxel error also bounds trilinear lookups
+    std::cout << "volumes " << i << " " << toString(m_encoding) << std::endl;
+    std::cout << "  xyz - max error " << encoded_xyz[i].max_error << " m, rms " << encoded_xyz[i].rms_error
+              << ", " << toMB(calib_xyz.numVoxels() * 12) << " -> " << toMB(encoded_xyz[i].data.size() * 2)
+              << ", lookup 96 B -> 48 B" << std::endl;
+    std::cout << "  uv - max error " << encoded_uv[i].max_error << ", rms " << encoded_uv[i].rms_error
+              << ", " << toMB(calib_uv.numVoxels() * 8) << " -> " << toMB(encoded_uv[i].data.size() * 2)
+              << ", lookup 64 B -> 32 B" << std::endl;
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void CalibVolumes::loadAnalyticModels() {
+  // models are written next to the volumes by calib_fitter
+  for(unsigned i = 0; i < m_cv_xyz_filenames.size(); ++i){
+    if (!std::ifstream{m_cv_xyz_filenames[i] + "_model"} || !std::ifstream{m_cv_uv_filenames[i] + "_model"}) {
+      std::cout << "no analytic calibration models found" << std::endl;
+      return;
+    }
+  }
+  sensor::Timer timer{};
+  timer.start();
+  m_analytic_xyz.resize(m_cv_xyz_filenames.size());
+  m_analytic_uv.resize(m_cv_uv_filenames.size());
+  #pragma omp parallel for
+  for(int i = 0; i < int(m_cv_xyz_filenames.size()); ++i){
+    m_analytic_xyz[i] = CalibrationModel{m_cv_xyz_filenames[i] + "_model"};
+    m_analytic_uv[i] = CalibrationModel{m_cv_uv_filenames[i] + "_model"};
+  }
+
+  for(unsigned i = 0; i < m_analytic_xyz.size(); ++i){
+    auto const& model_xyz = m_analytic_xyz[i];
+    auto grid_xyz = globjects::Texture::createDefault(GL_TEXTURE_3D);
+    grid_xyz->image3D(0, GL_RGB32F, glm::ivec3{model_xyz.gridRes()}, 0, GL_RGB, GL_FLOAT, model_xyz.grid().data());
+    m_grids_xyz.push_back(grid_xyz);
+
+    auto const& model_uv = m_analytic_uv[i];
+    auto grid_uv = globjects::Texture::createDefault(GL_TEXTURE_3D);
+    grid_uv->image3D(0, GL_RG32F, glm::ivec3{model_uv.gridRes()}, 0, GL_RG, GL_FLOAT, model_uv.grid().data());
+    m_grids_uv.push_back(grid_uv);
+    std::cout << "analytic model " << i << " - grid xyz " << model_xyz.gridRes().x << ", " << model_xyz.gridRes().y << ", " << model_xyz.gridRes().z
+              << ", " << toMB(model_xyz.numBytes() + model_uv.numBytes()) << std::endl;
+  }
+  timer.stop();
+  std::cout << "loading analytic models took " << timer.get().msec() << " ms" << std::endl;
+}
+
+void CalibVolumes::updateModelBuffer() {
+  // std140 layout of the CalibModels block
+  struct {
+    glm::fvec4 xyz[5 * CalibrationModel::num_terms];
+    glm::fvec4 uv[5 * CalibrationModel::num_terms];
+    glm::uvec4 analytic;
+  } block{};
+  for(unsigned i = 0; i < m_analytic_xyz.size(); ++i) {
+    for(unsigned k = 0; k < CalibrationModel::num_terms; ++k) {
+      block.xyz[i * CalibrationModel::num_terms + k] = m_analytic_xyz[i].coefficients()[k];
+      block.uv[i * CalibrationModel::num_terms + k] = m_analytic_uv[i].coefficients()[k];
+    }
+  }
+  block.analytic = glm::uvec4{m_analytic ? 1u : 0u};
+  m_buffer_models->setData(sizeof(block), &block, GL_STATIC_DRAW);
+  m_buffer_models->bindBase(GL_UNIFORM_BUFFER, uniform_binding_models);
+}
+
+bool CalibVolumes::hasAnalyticModels() const {
+  return !m_analytic_xyz.empty();
+}
+
+bool CalibVolumes::isAnalytic() const {
+  return m_analytic;
+}
+
+void CalibVolumes::setAnalytic(bool enable) {
+  m_analytic = enable && hasAnalyticModels();
+  updateModelBuffer();
+}
+
+VolumeEncoding CalibVolumes::getEncoding() const {
+  return m_encoding;
+}
+
+void CalibVolumes::setDecodeUniforms(globjects::Program* program) const {
+  std::vector<glm::fvec2> depth_limits(5, glm::fvec2{0.0f});
+  // float volumes have no model and unit scale
+  std::vector<glm::fmat4> models_xyz(5, glm::fmat4{0.0f});
+  std::vector<glm::fmat4> models_uv(5, glm::fmat4{0.0f});
+  std::vector<glm::fvec3> scales_xyz(5, glm::fvec3{1.0f});
+  std::vector<glm::fvec2> scales_uv(5, glm::fvec2{1.0f});
+  for(unsigned i = 0; i < m_data_volumes_xyz.size(); ++i) {
+    depth_limits[i] = m_data_volumes_xyz[i].depthLimits();
+  }
+  for(unsigned i = 0; i < m_models_xyz.size(); ++i) {
+    models_xyz[i] = m_models_xyz[i];
+    models_uv[i] = m_models_uv[i];
+    scales_xyz[i] = m_scales_xyz[i];
+    scales_uv[i] = m_scales_uv[i];
+  }
+  program->setUniform("cv_depth_limits", depth_limits);
+  program->setUniform("cv_xyz_model", models_xyz);
+  program->setUniform("cv_uv_model", models_uv);
+  program->setUniform("cv_xyz_scale", scales_xyz);
+  program->setUniform("cv_uv_scale", scales_uv);
+
+  std::vector<int> units_xyz(5, 0);
+  std::vector<int> units_uv(5, 0);
+  for(int i = 0; i < int(m_grids_xyz.size()); ++i) {
+    units_xyz[i] = m_start_texture_unit_grid + i * 2;
+    units_uv[i] = m_start_texture_unit_grid + i * 2 + 1;
+  }
+  program->setUniform("cv_xyz_grid", units_xyz);
+  program->setUniform("cv_uv_grid", units_uv);
+  // block is inactive when the shader never samples the volumes
+  if (program->getUniformBlockIndex("CalibModels") != GL_INVALID_INDEX) {
+    program->uniformBlock("CalibModels")->setBinding(uniform_binding_models);
+  }
+}
+
 std::vector<int> CalibVolumes::getXYZVolumeUnits() const {
   std::vector<int> units(5, 0);
   for(int i = 0; i < int(m_cv_xyz_filenames.size()); ++i) {
@@ -162,6 +427,16 @@ CalibVolumes::bindToTextureUnitsInv() {
   for(unsigned layer = 0; layer < m_cv_xyz_filenames.size(); ++layer){
     m_volumes_xyz_inv[layer]->bindActive(GL_TEXTURE0 + m_start_texture_unit_inv + layer);
   }
+  m_volume_valid->bindActive(GL_TEXTURE0 + getValidityVolumeUnit());
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void
+CalibVolumes::bindToTextureUnitsGrid() {
+  for(unsigned layer = 0; layer < m_grids_xyz.size(); ++layer){
+    m_grids_xyz[layer]->bindActive(GL_TEXTURE0 + m_start_texture_unit_grid + layer * 2);
+    m_grids_uv[layer]->bindActive(GL_TEXTURE0 + m_start_texture_unit_grid + layer * 2 + 1);
+  }
   glActiveTexture(GL_TEXTURE0);
 }
 
@@ -175,24 +450,27 @@ void CalibVolumes::setStartTextureUnitInv(unsigned start_texture_unit) {
   bindToTextureUnitsInv();
 }
 
+void CalibVolumes::setStartTextureUnitGrid(unsigned start_texture_unit) {
+  m_start_texture_unit_grid = start_texture_unit;
+  bindToTextureUnitsGrid();
+}
+
 void CalibVolumes::drawValidVoxels() const {
   glm::fvec3 bbox_dimensions = glm::fvec3{m_bbox.getPMax()[0] - m_bbox.getPMin()[0],
                                         m_bbox.getPMax()[1] - m_bbox.getPMin()[1],
                                         m_bbox.getPMax()[2] - m_bbox.getPMin()[2]};
   glm::fvec3 bbox_translation = glm::fvec3{m_bbox.getPMin()[0], m_bbox.getPMin()[1], m_bbox.getPMin()[2]};
 
-  glm::fvec3 const& dims{m_data_volumes_xyz_inv[0].res()};
+  glm::uvec3 const& res{m_data_volume_valid.res()};
+  glm::fvec3 dims{res};
+  std::uint8_t all_cameras{allCameras(m_frustums.size())};
   glPointSize(1.0f);
   glBegin(GL_POINTS);
-  for(unsigned x = 0; x < dims.x; ++x) {
-    for(unsigned y = 0; y < dims.y; ++y) {
-      for(unsigned z = 0; z < dims.z; ++z) {
-        glm::fvec3 pos{glm::fvec3{x,y,z} / dims * bbox_dimensions + bbox_translation};
-        bool inside = true;
-        for(unsigned i = 0; i < m_frustums.size(); ++i) {
-           inside &= m_frustums[i].inside(pos);
-        }
-        if (inside) {
+  for(unsigned x = 0; x < res.x; ++x) {
+    for(unsigned y = 0; y < res.y; ++y) {
+      for(unsigned z = 0; z < res.z; ++z) {
+        if (m_data_volume_valid(x, y, z) == all_cameras) {
+          glm::fvec3 pos{(glm::fvec3{x,y,z} + 0.5f) / dims * bbox_dimensions + bbox_translation};
           glVertex3f(pos.x, pos.y, pos.z);
         }
       }
@@ -2,6 +2,8 @@
 #define KINECT_CalibVolumes_H
 
 #include "calibration_volume.hpp"
+#include "volume_encoding.hpp"
+#include "calibration_model.hpp"
 #include "frustum.hpp"
 #include <DataTypes.h>
 #include "volume_sampler.hpp"
@@ -18,19 +20,33 @@
 
 namespace kinect{
 
+class CalibrationFiles;
+
 class CalibVolumes{
 
 public:
-  CalibVolumes(std::vector<std::string> const& calib_volume_files, gloost::BoundingBox const& bbox);
+  CalibVolumes(CalibrationFiles const& cfs, gloost::BoundingBox const& bbox, VolumeEncoding encoding = VolumeEncoding::FLOAT);
   ~CalibVolumes();
   
   void setStartTextureUnit(unsigned start_texture_unit);
   void setStartTextureUnitInv(unsigned start_texture_unit);
+  void setStartTextureUnitGrid(unsigned start_texture_unit);
 
   std::vector<int> getXYZVolumeUnits() const;
   std::vector<int> getUVVolumeUnits() const;
 
   std::vector<int> getXYZVolumeUnitsInv() const;
+  // usampler3D with one bit per camera seeing the voxel, same resolution as the inverse volumes
+  int getValidityVolumeUnit() const;
+
+  // models and residual scales the shaders need to decode the volumes
+  void setDecodeUniforms(globjects::Program* program) const;
+  VolumeEncoding getEncoding() const;
+
+  // evaluate fitted models instead of sampling the volumes, in shaders defining CALIB_ANALYTIC
+  bool hasAnalyticModels() const;
+  bool isAnalytic() const;
+  void setAnalytic(bool enable);
 
   void calculateInverseVolumes();
   void calculateInverseVolumes2();
@@ -49,8 +65,12 @@ public:
 private:
   void bindToTextureUnits();
   void bindToTextureUnitsInv();
+  void bindToTextureUnitsGrid();
 
   void createVolumeTextures();
+  void createEncodedVolumeTextures();
+  void loadAnalyticModels();
+  void updateModelBuffer();
   std::vector<sample_t> getXyzSamples(std::size_t i);
 
   std::vector<std::string> m_cv_xyz_filenames;
@@ -65,15 +85,32 @@ private:
   std::vector<CalibrationVolume<xyz>>    m_data_volumes_xyz;
   std::vector<CalibrationVolume<uv>>    m_data_volumes_uv;
   std::vector<CalibrationVolume<glm::fvec4>>    m_data_volumes_xyz_inv;
+  CalibrationVolume<std::uint8_t>               m_data_volume_valid;
+  globjects::Texture*                           m_volume_valid;
 
   std::vector<Frustum>    m_frustums;
   gloost::BoundingBox m_bbox;
 
+  VolumeEncoding           m_encoding;
+  std::vector<glm::fvec4>  m_intrinsics;
+  std::vector<glm::fmat4>  m_models_xyz;
+  std::vector<glm::fmat4>  m_models_uv;
+  std::vector<glm::fvec3>  m_scales_xyz;
+  std::vector<glm::fvec2>  m_scales_uv;
+
+  std::vector<CalibrationModel>    m_analytic_xyz;
+  std::vector<CalibrationModel>    m_analytic_uv;
+  std::vector<globjects::Texture*> m_grids_xyz;
+  std::vector<globjects::Texture*> m_grids_uv;
+  globjects::Buffer*               m_buffer_models;
+  bool                             m_analytic;
+
  protected:
   int m_start_texture_unit;
   int m_start_texture_unit_inv;
+  int m_start_texture_unit_grid;
 
-  void addVolume(std::string const& filename_xyz, std::string const& filename_uv);
+  void loadVolumes();
 };
 
 }
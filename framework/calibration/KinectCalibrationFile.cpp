@@ -1019,6 +1019,11 @@ unsigned
   return _heightc;
 }
 
+glm::fvec4
+KinectCalibrationFile::getDepthIntrinsics() const {
+  return glm::fvec4{_depthFocalLength.u, _depthFocalLength.v, _depthPrincipalPoint.u, _depthPrincipalPoint.v};
+}
+
   unsigned
   KinectCalibrationFile::isCompressedRGB() const {
     return _iscompressedrgb;
@@ -40,6 +40,9 @@ namespace kinect
     unsigned getWidthC() const;
     unsigned getHeightC() const;
 
+    // depth camera focal length and principal point in pixels
+    glm::fvec4 getDepthIntrinsics() const;
+
     unsigned isCompressedRGB() const;
     bool isCompressedDepth() const;
 
@@ -1,7 +1,9 @@
 #include "calibration_files.hpp"
 #include <KinectCalibrationFile.h>
+#include <Timer.h>
 
 #include <fstream>
+#include <iostream>
 
 namespace kinect{
   CalibrationFiles::CalibrationFiles(std::vector<std::string> const& calib_filenames)
@@ -34,9 +36,15 @@ namespace kinect{
   }
 
   void CalibrationFiles::reload() {
-    for (auto& calib : m_calibs) {
-      calib.parse();
+    sensor::Timer timer{};
+    timer.start();
+    // files are independent, parsing only reads shared settings
+    #pragma omp parallel for
+    for (int i = 0; i < int(m_calibs.size()); ++i) {
+      m_calibs[i].parse();
     }
+    timer.stop();
+    std::cout << "parsing calibration files took " << timer.get().msec() << " ms" << std::endl;
   }
 
   unsigned
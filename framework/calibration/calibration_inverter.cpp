@@ -1,16 +1,21 @@
 #include "calibration_inverter.hpp"
+#include "validity_volume.hpp"
 #include <KinectCalibrationFile.h>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/norm.hpp>
+#include <glm/glm.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 
 namespace kinect{
 
 CalibrationInverter::CalibrationInverter(std::vector<std::string> const& calib_volume_files, gloost::BoundingBox const& bbox)
  :m_cv_xyz_filenames()
+ ,m_data_volume_valid{}
  ,m_frustums{}
  ,m_bbox{bbox}
 {
@@ -33,6 +38,8 @@ void CalibrationInverter::writeInverseVolumes(std::string const& path) const {
     std::cout << "writing to file " << name_output << std::endl;
     m_data_volumes_xyz_inv[i].write(name_output);
   }
+  std::cout << "writing to file " << path + "cv_valid" << std::endl;
+  writeValidityVolume(path + "cv_valid", m_data_volume_valid, m_bbox, m_frustums.size());
 }
 
 std::vector<sample_t> CalibrationInverter::getXyzSamples(std::size_t i) {
@@ -65,7 +72,44 @@ static glm::fvec3 inverseDistance(glm::fvec3 const& curr_point, std::vector<samp
   return weighted_index;
 }
 
-void CalibrationInverter::calculateInverseVolumes(glm::uvec3 const& volume_res) {
+// trilinear lookup with texture semantics, coords are normalized
+static glm::fvec3 sampleTrilinear(CalibrationVolume<xyz> const& volume, glm::fvec3 const& coords) {
+  glm::uvec3 const& res{volume.res()};
+  glm::fvec3 pos{glm::clamp(coords * glm::fvec3{res} - 0.5f, glm::fvec3{0.0f}, glm::fvec3{res - glm::uvec3{1}})};
+  glm::uvec3 p0{glm::floor(pos)};
+  glm::uvec3 p1{glm::min(p0 + glm::uvec3{1}, res - glm::uvec3{1})};
+  glm::fvec3 t{pos - glm::fvec3{p0}};
+  glm::fvec3 value{0.0f};
+  for(unsigned corner = 0; corner < 8; ++corner) {
+    float weight = (corner & 1 ? t.x : 1.0f - t.x) * (corner & 2 ? t.y : 1.0f - t.y) * (corner & 4 ? t.z : 1.0f - t.z);
+    glm::fvec3 sample = volume(corner & 1 ? p1.x : p0.x, corner & 2 ? p1.y : p0.y, corner & 4 ? p1.z : p0.z);
+    value += sample * weight;
+  }
+  return value;
+}
+
+// solves forward(coords) = target starting from the given coords
+static glm::fvec3 refineNewton(CalibrationVolume<xyz> const& volume, glm::fvec3 const& target, glm::fvec3 coords, unsigned iterations) {
+  glm::fvec3 texel{glm::fvec3{1.0f} / glm::fvec3{volume.res()}};
+  // central differences over one texel, the mapping is piecewise trilinear
+  glm::fvec3 h{texel * 0.5f};
+  for(unsigned i = 0; i < iterations; ++i) {
+    glm::fvec3 residual{target - sampleTrilinear(volume, coords)};
+    glm::fmat3 jacobian{};
+    for(unsigned axis = 0; axis < 3; ++axis) {
+      glm::fvec3 offset{0.0f};
+      offset[axis] = h[axis];
+      jacobian[axis] = (sampleTrilinear(volume, coords + offset) - sampleTrilinear(volume, coords - offset)) / (2.0f * h[axis]);
+    }
+    if (std::abs(glm::determinant(jacobian)) < 1e-12f) {
+      break;
+    }
+    coords = glm::clamp(coords + glm::inverse(jacobian) * residual, texel * 0.5f, glm::fvec3{1.0f} - texel * 0.5f);
+  }
+  return coords;
+}
+
+void CalibrationInverter::calculateInverseVolumes(glm::uvec3 const& volume_res, unsigned newton_iterations) {
   glm::fvec3 bbox_dimensions = glm::fvec3{m_bbox.getPMax()[0] - m_bbox.getPMin()[0],
                                           m_bbox.getPMax()[1] - m_bbox.getPMin()[1],
                                           m_bbox.getPMax()[2] - m_bbox.getPMin()[2]};
@@ -77,6 +121,8 @@ void CalibrationInverter::calculateInverseVolumes(glm::uvec3 const& volume_res)
   glm::fvec3 sample_start = bbox_translation + sample_step * 0.5f;
   glm::fvec3 sample_pos = sample_start;
 
+  m_data_volume_valid = computeValidityVolume(m_frustums, m_bbox, volume_res);
+
   for(unsigned i = 0; i < m_cv_xyz_filenames.size(); ++i) {
     glm::fvec3 curr_calib_dims{m_data_volumes_xyz[i].res()};
     auto curr_calib_samples(getXyzSamples(i));
@@ -85,20 +131,45 @@ void CalibrationInverter::calculateInverseVolumes(glm::uvec3 const& volume_res)
     std::cout << "start neighbour search" << std::endl;
 
     std::vector<glm::fvec4> curr_volume_inv(volume_res.x * volume_res.y * volume_res.z, glm::fvec4{-1.0f});
-    #pragma omp parallel for
+    // forward mapping error of the stored coordinates
+    double sum_sq_error_idw = 0.0;
+    double sum_sq_error = 0.0;
+    float max_error_idw = 0.0f;
+    float max_error = 0.0f;
+    std::size_t num_valid = 0;
+    #pragma omp parallel for reduction(+:sum_sq_error_idw, sum_sq_error, num_valid) reduction(max:max_error_idw, max_error)
     for(unsigned x = 0; x < volume_res.x; ++x) {
       for(unsigned y = 0; y < volume_res.y; ++y) {
         for(unsigned z = 0; z < volume_res.z; ++z) {
           glm::fvec3 sample_pos = sample_start + glm::fvec3{x,y,z} * sample_step;
           // invalidate if point is not visible from camera
-          if (!m_frustums[i].inside(sample_pos)) {
+          if (!(m_data_volume_valid(x, y, z) & (1u << i))) {
             curr_volume_inv[z * volume_res.x * volume_res.y + y * volume_res.x + x] = glm::fvec4{-1.0f};
             continue;
           }
 
           auto samples = curr_calib_search.search(sample_pos, 8);
           auto weighted_index = inverseDistance(sample_pos, samples);
-          curr_volume_inv[z * volume_res.x * volume_res.y + y * volume_res.x + x] = glm::fvec4{(weighted_index + glm::fvec3{0.5f}) / curr_calib_dims, 1.0f};
+          glm::fvec3 coords_idw{(weighted_index + glm::fvec3{0.5f}) / curr_calib_dims};
+          float error_idw = glm::distance(sampleTrilinear(m_data_volumes_xyz[i], coords_idw), sample_pos);
+          glm::fvec3 coords{coords_idw};
+          float error = error_idw;
+          if (newton_iterations > 0) {
+            glm::fvec3 coords_newton{refineNewton(m_data_volumes_xyz[i], sample_pos, coords_idw, newton_iterations)};
+            float error_newton = glm::distance(sampleTrilinear(m_data_volumes_xyz[i], coords_newton), sample_pos);
+            // keep the blend where iterations diverge at the volume border
+            if (error_newton < error_idw) {
+              coords = coords_newton;
+              error = error_newton;
+            }
+          }
+          curr_volume_inv[z * volume_res.x * volume_res.y + y * volume_res.x + x] = glm::fvec4{coords, 1.0f};
+
+          sum_sq_error_idw += double(error_idw) * error_idw;
+          sum_sq_error += double(error) * error;
+          max_error_idw = std::max(max_error_idw, error_idw);
+          max_error = std::max(max_error, error);
+          ++num_valid;
 
           sample_pos.z += sample_step.z;
         }
@@ -110,6 +181,11 @@ void CalibrationInverter::calculateInverseVolumes(glm::uvec3 const& volume_res)
       sample_pos.x += sample_step.x;
       sample_pos.y = sample_start.y;
     }
+    num_valid = std::max(num_valid, std::size_t{1});
+    std::cout << "residual inverse distance - max " << max_error_idw * 1000.0f << " mm, rms " << std::sqrt(sum_sq_error_idw / num_valid) * 1000.0 << " mm" << std::endl;
+    if (newton_iterations > 0) {
+      std::cout << "residual " << newton_iterations << " newton iterations - max " << max_error * 1000.0f << " mm, rms " << std::sqrt(sum_sq_error / num_valid) * 1000.0 << " mm" << std::endl;
+    }
     m_data_volumes_xyz_inv.emplace_back(volume_res, glm::fvec2{0.5f, 4.5f}, curr_volume_inv);
   }
 }
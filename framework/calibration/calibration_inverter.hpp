@@ -23,7 +23,8 @@ class CalibrationInverter{
 public:
   CalibrationInverter(std::vector<std::string> const& calib_volume_files, gloost::BoundingBox const& bbox);
 
-  void calculateInverseVolumes(glm::uvec3 const& volume_res);
+  // refines the inverse with newton iterations against the trilinear forward mapping
+  void calculateInverseVolumes(glm::uvec3 const& volume_res, unsigned newton_iterations = 0);
 
   void writeInverseVolumes(std::string const& path) const;
 
@@ -34,6 +35,7 @@ private:
 
   std::vector<CalibrationVolume<xyz>>    m_data_volumes_xyz;
   std::vector<CalibrationVolume<glm::fvec4>>    m_data_volumes_xyz_inv;
+  CalibrationVolume<std::uint8_t>               m_data_volume_valid;
 
   std::vector<Frustum>    m_frustums;
   gloost::BoundingBox m_bbox;
@@ -0,0 +1,249 @@
+#include "calibration_model.hpp"
+#include "volume_encoding.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace kinect{
+
+std::array<float, CalibrationModel::num_terms> polynomialTerms(glm::fvec3 const& coords) {
+  // center coords to improve conditioning of the fit
+  glm::fvec3 p{coords * 2.0f - 1.0f};
+  return std::array<float, CalibrationModel::num_terms>{{
+    1.0f,
+    p.x, p.y, p.z,
+    p.x * p.x, p.x * p.y, p.x * p.z, p.y * p.y, p.y * p.z, p.z * p.z,
+    p.x * p.x * p.x, p.x * p.x * p.y, p.x * p.x * p.z, p.x * p.y * p.y, p.x * p.y * p.z,
+    p.x * p.z * p.z, p.y * p.y * p.y, p.y * p.y * p.z, p.y * p.z * p.z, p.z * p.z * p.z
+  }};
+}
+
+// gaussian elimination with partial pivoting, b holds m right hand sides per row
+static void solve(std::vector<double> a, std::vector<double>& b, unsigned n, unsigned m) {
+  for(unsigned col = 0; col < n; ++col) {
+    unsigned pivot = col;
+    for(unsigned row = col + 1; row < n; ++row) {
+      if (std::abs(a[row * n + col]) > std::abs(a[pivot * n + col])) {
+        pivot = row;
+      }
+    }
+    if (a[pivot * n + col] == 0.0) {
+      throw std::runtime_error{"singular system in calibration model fit"};
+    }
+    for(unsigned j = 0; j < n; ++j) {
+      std::swap(a[col * n + j], a[pivot * n + j]);
+    }
+    for(unsigned j = 0; j < m; ++j) {
+      std::swap(b[col * m + j], b[pivot * m + j]);
+    }
+    for(unsigned row = col + 1; row < n; ++row) {
+      double factor = a[row * n + col] / a[col * n + col];
+      for(unsigned j = col; j < n; ++j) {
+        a[row * n + j] -= factor * a[col * n + j];
+      }
+      for(unsigned j = 0; j < m; ++j) {
+        b[row * m + j] -= factor * b[col * m + j];
+      }
+    }
+  }
+  for(unsigned col = n; col-- > 0;) {
+    for(unsigned j = 0; j < m; ++j) {
+      double sum = b[col * m + j];
+      for(unsigned k = col + 1; k < n; ++k) {
+        sum -= a[col * n + k] * b[k * m + j];
+      }
+      b[col * m + j] = sum / a[col * n + col];
+    }
+  }
+}
+
+CalibrationModel::CalibrationModel()
+ :m_channels{0}
+ ,m_grid_res{0}
+ ,m_coefficients{}
+ ,m_grid{}
+{}
+
+CalibrationModel::CalibrationModel(std::string const& filename)
+ :CalibrationModel{}
+{
+  FILE* file_input = fopen(filename.c_str(), "rb");
+  if (!file_input) {
+    throw std::runtime_error{"could not open " + filename};
+  }
+  std::size_t res = 0;
+  res = fread(&m_channels, sizeof(unsigned), 1, file_input);
+  assert(res == 1);
+  res = fread(&m_grid_res.x, sizeof(unsigned), 1, file_input);
+  assert(res == 1);
+  res = fread(&m_grid_res.y, sizeof(unsigned), 1, file_input);
+  assert(res == 1);
+  res = fread(&m_grid_res.z, sizeof(unsigned), 1, file_input);
+  assert(res == 1);
+  m_coefficients.resize(num_terms);
+  res = fread(m_coefficients.data(), sizeof(glm::fvec4), m_coefficients.size(), file_input);
+  assert(res == num_terms);
+  m_grid.resize(m_grid_res.x * m_grid_res.y * m_grid_res.z * m_channels);
+  res = fread(m_grid.data(), sizeof(float), m_grid.size(), file_input);
+  assert(res == m_grid.size());
+  fclose(file_input);
+}
+
+CalibrationModel::CalibrationModel(std::vector<float> const& values, unsigned channels,
+                                   glm::uvec3 const& volume_res, glm::uvec3 const& grid_res)
+ :m_channels{channels}
+ ,m_grid_res{grid_res}
+ ,m_coefficients(num_terms, glm::fvec4{0.0f})
+ ,m_grid(grid_res.x * grid_res.y * grid_res.z * channels, 0.0f)
+{
+  fitPolynomial(values, volume_res);
+  fitGrid(values, volume_res);
+}
+
+void CalibrationModel::write(std::string const& filename) const {
+  FILE* file_output = fopen(filename.c_str(), "wb");
+  fwrite(&m_channels, sizeof(unsigned), 1, file_output);
+  fwrite(&m_grid_res.x, sizeof(unsigned), 1, file_output);
+  fwrite(&m_grid_res.y, sizeof(unsigned), 1, file_output);
+  fwrite(&m_grid_res.z, sizeof(unsigned), 1, file_output);
+  fwrite(m_coefficients.data(), sizeof(glm::fvec4), m_coefficients.size(), file_output);
+  fwrite(m_grid.data(), sizeof(float), m_grid.size(), file_output);
+  fclose(file_output);
+}
+
+void CalibrationModel::fitPolynomial(std::vector<float> const& values, glm::uvec3 const& volume_res) {
+  std::size_t num_voxels = std::size_t(volume_res.x) * volume_res.y * volume_res.z;
+  std::vector<double> normal(num_terms * num_terms, 0.0);
+  std::vector<double> rhs(num_terms * m_channels, 0.0);
+  #pragma omp parallel
+  {
+    std::vector<double> normal_local(normal.size(), 0.0);
+    std::vector<double> rhs_local(rhs.size(), 0.0);
+    #pragma omp for
+    for(std::size_t i = 0; i < num_voxels; ++i) {
+      auto terms = polynomialTerms(voxelCoords(volume_res, i));
+      for(unsigned a = 0; a < num_terms; ++a) {
+        for(unsigned b = a; b < num_terms; ++b) {
+          normal_local[a * num_terms + b] += double(terms[a]) * terms[b];
+        }
+        for(unsigned c = 0; c < m_channels; ++c) {
+          rhs_local[a * m_channels + c] += double(terms[a]) * values[i * m_channels + c];
+        }
+      }
+    }
+    #pragma omp critical
+    {
+      for(std::size_t j = 0; j < normal.size(); ++j) {
+        normal[j] += normal_local[j];
+      }
+      for(std::size_t j = 0; j < rhs.size(); ++j) {
+        rhs[j] += rhs_local[j];
+      }
+    }
+  }
+  // only the upper triangle was accumulated
+  for(unsigned a = 0; a < num_terms; ++a) {
+    for(unsigned b = 0; b < a; ++b) {
+      normal[a * num_terms + b] = normal[b * num_terms + a];
+    }
+  }
+  solve(normal, rhs, num_terms, m_channels);
+  for(unsigned a = 0; a < num_terms; ++a) {
+    for(unsigned c = 0; c < m_channels; ++c) {
+      m_coefficients[a][c] = float(rhs[a * m_channels + c]);
+    }
+  }
+}
+
+void CalibrationModel::fitGrid(std::vector<float> const& values, glm::uvec3 const& volume_res) {
+  // box filtered polynomial residual, one grid cell per texel
+  std::size_t num_voxels = std::size_t(volume_res.x) * volume_res.y * volume_res.z;
+  std::vector<double> sums(m_grid.size(), 0.0);
+  std::vector<unsigned> counts(m_grid.size() / m_channels, 0);
+  for(std::size_t i = 0; i < num_voxels; ++i) {
+    glm::fvec3 coords{voxelCoords(volume_res, i)};
+    glm::uvec3 cell{glm::min(glm::uvec3{coords * glm::fvec3{m_grid_res}}, m_grid_res - glm::uvec3{1})};
+    std::size_t index = (cell.z * m_grid_res.y + cell.y) * m_grid_res.x + cell.x;
+    glm::fvec4 poly{evaluate(coords, false)};
+    for(unsigned c = 0; c < m_channels; ++c) {
+      sums[index * m_channels + c] += values[i * m_channels + c] - poly[c];
+    }
+    ++counts[index];
+  }
+  for(std::size_t i = 0; i < m_grid.size(); ++i) {
+    unsigned count = counts[i / m_channels];
+    m_grid[i] = count > 0 ? float(sums[i] / count) : 0.0f;
+  }
+}
+
+glm::fvec4 CalibrationModel::sampleGrid(glm::fvec3 const& coords) const {
+  // same as linear filtering with clamp to edge
+  glm::fvec3 pos{glm::clamp(coords * glm::fvec3{m_grid_res} - 0.5f, glm::fvec3{0.0f}, glm::fvec3{m_grid_res - glm::uvec3{1}})};
+  glm::uvec3 p0{glm::floor(pos)};
+  glm::uvec3 p1{glm::min(p0 + glm::uvec3{1}, m_grid_res - glm::uvec3{1})};
+  glm::fvec3 t{pos - glm::fvec3{p0}};
+  glm::fvec4 value{0.0f};
+  for(unsigned corner = 0; corner < 8; ++corner) {
+    glm::uvec3 p{corner & 1 ? p1.x : p0.x, corner & 2 ? p1.y : p0.y, corner & 4 ? p1.z : p0.z};
+    float weight = (corner & 1 ? t.x : 1.0f - t.x) * (corner & 2 ? t.y : 1.0f - t.y) * (corner & 4 ? t.z : 1.0f - t.z);
+    std::size_t index = (p.z * m_grid_res.y + p.y) * m_grid_res.x + p.x;
+    for(unsigned c = 0; c < m_channels; ++c) {
+      value[c] += m_grid[index * m_channels + c] * weight;
+    }
+  }
+  return value;
+}
+
+glm::fvec4 CalibrationModel::evaluate(glm::fvec3 const& coords, bool use_grid) const {
+  auto terms = polynomialTerms(coords);
+  glm::fvec4 value{use_grid ? sampleGrid(coords) : glm::fvec4{0.0f}};
+  for(unsigned k = 0; k < num_terms; ++k) {
+    value += m_coefficients[k] * terms[k];
+  }
+  return value;
+}
+
+glm::fvec2 CalibrationModel::error(std::vector<float> const& values, glm::uvec3 const& volume_res, bool use_grid) const {
+  std::size_t num_voxels = std::size_t(volume_res.x) * volume_res.y * volume_res.z;
+  double sum_sq_error = 0.0;
+  float max_error = 0.0f;
+  #pragma omp parallel for reduction(+:sum_sq_error) reduction(max:max_error)
+  for(std::size_t i = 0; i < num_voxels; ++i) {
+    glm::fvec4 value{evaluate(voxelCoords(volume_res, i), use_grid)};
+    float sq_error = 0.0f;
+    for(unsigned c = 0; c < m_channels; ++c) {
+      float diff = value[c] - values[i * m_channels + c];
+      sq_error += diff * diff;
+    }
+    max_error = std::max(max_error, std::sqrt(sq_error));
+    sum_sq_error += sq_error;
+  }
+  return glm::fvec2{max_error, float(std::sqrt(sum_sq_error / double(num_voxels)))};
+}
+
+unsigned CalibrationModel::channels() const {
+  return m_channels;
+}
+
+glm::uvec3 const& CalibrationModel::gridRes() const {
+  return m_grid_res;
+}
+
+std::vector<glm::fvec4> const& CalibrationModel::coefficients() const {
+  return m_coefficients;
+}
+
+std::vector<float> const& CalibrationModel::grid() const {
+  return m_grid;
+}
+
+std::size_t CalibrationModel::numBytes() const {
+  return m_coefficients.size() * sizeof(glm::fvec4) + m_grid.size() * sizeof(float);
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef KINECT_CALIBRATION_MODEL_HPP
+#define KINECT_CALIBRATION_MODEL_HPP
+
+#include <glm/gtc/type_precision.hpp>
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace kinect{
+
+// compact replacement for a calibration volume, evaluated arithmetically
+// value(coords) = sum_k coefficient_k * term_k(coords) + trilinear(residual grid, coords)
+class CalibrationModel {
+ public:
+  // all monomials of the centered coords up to degree 3
+  static const unsigned num_terms = 20;
+
+  CalibrationModel();
+  CalibrationModel(std::string const& filename);
+  // fits polynomial and residual grid to the interleaved volume values
+  CalibrationModel(std::vector<float> const& values, unsigned channels,
+                   glm::uvec3 const& volume_res, glm::uvec3 const& grid_res);
+
+  void write(std::string const& filename) const;
+
+  glm::fvec4 evaluate(glm::fvec3 const& coords, bool use_grid = true) const;
+  // max and rms deviation from the volume at all voxel centers
+  glm::fvec2 error(std::vector<float> const& values, glm::uvec3 const& volume_res, bool use_grid = true) const;
+
+  unsigned channels() const;
+  glm::uvec3 const& gridRes() const;
+  // one coefficient per term, channels in the components
+  std::vector<glm::fvec4> const& coefficients() const;
+  // residual grid with interleaved channels
+  std::vector<float> const& grid() const;
+  std::size_t numBytes() const;
+
+ private:
+  void fitPolynomial(std::vector<float> const& values, glm::uvec3 const& volume_res);
+  void fitGrid(std::vector<float> const& values, glm::uvec3 const& volume_res);
+  glm::fvec4 sampleGrid(glm::fvec3 const& coords) const;
+
+  unsigned m_channels;
+  glm::uvec3 m_grid_res;
+  std::vector<glm::fvec4> m_coefficients;
+  std::vector<float> m_grid;
+};
+
+// order matches poly_terms in the shaders
+std::array<float, CalibrationModel::num_terms> polynomialTerms(glm::fvec3 const& coords);
+
+}
+
+#endif // #ifndef KINECT_CALIBRATION_MODEL_HPP
@@ -4,6 +4,7 @@
 #include <glm/gtc/type_precision.hpp>
 
 #include <cstdio>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -21,6 +22,12 @@ class CalibrationVolume {
     read(filename);
   }
 
+  CalibrationVolume()
+   :m_resolution{0}
+   ,m_depth_limits{0}
+   ,m_volume{}
+  {}
+
   CalibrationVolume(glm::uvec3 const& res, glm::fvec2 const& depth, std::vector<T> const& vol)
    :m_resolution{res}
    ,m_depth_limits{depth}
@@ -54,6 +61,14 @@ class CalibrationVolume {
     return m_volume;
   }
 
+  // values as interleaved floats, T must consist of floats only
+  std::vector<float> floats() const {
+    static_assert(sizeof(T) % sizeof(float) == 0, "volume type must consist of floats");
+    std::vector<float> values(m_volume.size() * sizeof(T) / sizeof(float));
+    std::memcpy(values.data(), m_volume.data(), values.size() * sizeof(float));
+    return values;
+  }
+
   T const& operator()(unsigned x, unsigned y, unsigned z) const {
     return m_volume[z * m_resolution.x * m_resolution.y + y * m_resolution.x + x];
   }
@@ -42,6 +42,27 @@ bool Frustum::inside(glm::fvec3 const& point) const {
   return true;
 }
 
+void Frustum::markInside(float const* x, float const* y, float const* z, std::size_t count,
+                         std::uint8_t bit, std::uint8_t* masks) const {
+  // copy planes to scalars so the loop vectorizes over the points
+  float const a0 = m_planes[0].x, b0 = m_planes[0].y, c0 = m_planes[0].z, d0 = m_planes[0].w;
+  float const a1 = m_planes[1].x, b1 = m_planes[1].y, c1 = m_planes[1].z, d1 = m_planes[1].w;
+  float const a2 = m_planes[2].x, b2 = m_planes[2].y, c2 = m_planes[2].z, d2 = m_planes[2].w;
+  float const a3 = m_planes[3].x, b3 = m_planes[3].y, c3 = m_planes[3].z, d3 = m_planes[3].w;
+  float const a4 = m_planes[4].x, b4 = m_planes[4].y, c4 = m_planes[4].z, d4 = m_planes[4].w;
+  float const a5 = m_planes[5].x, b5 = m_planes[5].y, c5 = m_planes[5].z, d5 = m_planes[5].w;
+  #pragma omp simd
+  for(std::size_t i = 0; i < count; ++i) {
+    bool inside = (a0 * x[i] + b0 * y[i] + c0 * z[i] + d0 >= 0.0f)
+                & (a1 * x[i] + b1 * y[i] + c1 * z[i] + d1 >= 0.0f)
+                & (a2 * x[i] + b2 * y[i] + c2 * z[i] + d2 >= 0.0f)
+                & (a3 * x[i] + b3 * y[i] + c3 * z[i] + d3 >= 0.0f)
+                & (a4 * x[i] + b4 * y[i] + c4 * z[i] + d4 >= 0.0f)
+                & (a5 * x[i] + b5 * y[i] + c5 * z[i] + d5 >= 0.0f);
+    masks[i] |= inside ? bit : std::uint8_t{0};
+  }
+}
+
 void Frustum::draw() const {
   glBegin(GL_LINES);
     glColor3f(0.0f, 1.0f, 0.0f);
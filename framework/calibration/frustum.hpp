@@ -3,6 +3,8 @@
 
 #include <glm/gtc/type_precision.hpp>
 #include <array>
+#include <cstddef>
+#include <cstdint>
 
 namespace kinect{
 
@@ -15,6 +17,9 @@ public:
 
   glm::fvec3 getCameraPos() const;
   bool inside(glm::fvec3 const& point) const;
+  // batch test of points given as coordinate arrays, sets bit in masks of points inside
+  void markInside(float const* x, float const* y, float const* z, std::size_t count,
+                  std::uint8_t bit, std::uint8_t* masks) const;
 
 private:
   std::array<glm::fvec3, 8> m_corners;
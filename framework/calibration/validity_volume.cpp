@@ -0,0 +1,142 @@
+#include "validity_volume.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <stdexcept>
+
+namespace kinect{
+
+// distinguishes the file from masks written without header
+static unsigned validity_magic = 0x56616c31;
+
+CalibrationVolume<std::uint8_t> computeValidityVolume(std::vector<Frustum> const& frustums,
+                                                      gloost::BoundingBox const& bbox,
+                                                      glm::uvec3 const& res) {
+  if (frustums.size() > 8) {
+    throw std::invalid_argument{"validity volume supports at most 8 cameras"};
+  }
+  glm::fvec3 bbox_dimensions = glm::fvec3{bbox.getPMax()[0] - bbox.getPMin()[0],
+                                          bbox.getPMax()[1] - bbox.getPMin()[1],
+                                          bbox.getPMax()[2] - bbox.getPMin()[2]};
+  glm::fvec3 bbox_translation = glm::fvec3{bbox.getPMin()[0], bbox.getPMin()[1], bbox.getPMin()[2]};
+  glm::fvec3 sample_step{bbox_dimensions / glm::fvec3{res}};
+  // voxel centers, same as the inverse volumes
+  glm::fvec3 sample_start = bbox_translation + sample_step * 0.5f;
+
+  std::vector<std::uint8_t> masks(std::size_t(res.x) * res.y * res.z, 0);
+  // each row of x is one block of points in SoA layout
+  std::vector<float> row_x(res.x);
+  for(unsigned x = 0; x < res.x; ++x) {
+    row_x[x] = sample_start.x + x * sample_step.x;
+  }
+  #pragma omp parallel
+  {
+    std::vector<float> row_y(res.x);
+    std::vector<float> row_z(res.x);
+    #pragma omp for
+    for(unsigned z = 0; z < res.z; ++z) {
+      std::fill(row_z.begin(), row_z.end(), sample_start.z + z * sample_step.z);
+      for(unsigned y = 0; y < res.y; ++y) {
+        std::fill(row_y.begin(), row_y.end(), sample_start.y + y * sample_step.y);
+        std::uint8_t* row_masks = masks.data() + (std::size_t(z) * res.y + y) * res.x;
+        for(unsigned i = 0; i < frustums.size(); ++i) {
+          frustums[i].markInside(row_x.data(), row_y.data(), row_z.data(), res.x, std::uint8_t(1u << i), row_masks);
+        }
+      }
+    }
+  }
+  return CalibrationVolume<std::uint8_t>{res, glm::fvec2{0.0f}, masks};
+}
+
+std::vector<unsigned> computeVisibleBricks(CalibrationVolume<std::uint8_t> const& valid, unsigned brick_size) {
+  glm::uvec3 res{valid.res()};
+  glm::uvec3 res_bricks{(res + brick_size - 1u) / brick_size};
+  std::vector<bool> bricks_seen(res_bricks.x * res_bricks.y * res_bricks.z, false);
+  for(unsigned z = 0; z < res.z; ++z) {
+    for(unsigned y = 0; y < res.y; ++y) {
+      for(unsigned x = 0; x < res.x; ++x) {
+        if (valid(x, y, z) != 0) {
+          glm::uvec3 brick{glm::uvec3{x, y, z} / brick_size};
+          bricks_seen[(brick.z * res_bricks.y + brick.y) * res_bricks.x + brick.x] = true;
+        }
+      }
+    }
+  }
+  // conservative, voxels are only tested at their centers
+  std::vector<unsigned> bricks{};
+  for(unsigned z = 0; z < res_bricks.z; ++z) {
+    for(unsigned y = 0; y < res_bricks.y; ++y) {
+      for(unsigned x = 0; x < res_bricks.x; ++x) {
+        bool seen = false;
+        for(unsigned n = 0; n < 27 && !seen; ++n) {
+          glm::ivec3 neighbour{glm::ivec3{x, y, z} + glm::ivec3{n % 3, (n / 3) % 3, n / 9} - 1};
+          if (glm::all(glm::greaterThanEqual(neighbour, glm::ivec3{0})) && glm::all(glm::lessThan(neighbour, glm::ivec3{res_bricks}))) {
+            seen = bricks_seen[(neighbour.z * res_bricks.y + neighbour.y) * res_bricks.x + neighbour.x];
+          }
+        }
+        if (seen) {
+          bricks.push_back((z * res_bricks.y + y) * res_bricks.x + x);
+        }
+      }
+    }
+  }
+  return bricks;
+}
+
+std::uint8_t allCameras(std::size_t num_cameras) {
+  return std::uint8_t((1u << num_cameras) - 1u);
+}
+
+void writeValidityVolume(std::string const& filename,
+                         CalibrationVolume<std::uint8_t> const& valid,
+                         gloost::BoundingBox const& bbox,
+                         std::size_t num_cameras) {
+  FILE* file_output = fopen(filename.c_str(), "wb");
+  if (!file_output) {
+    throw std::runtime_error{"could not open " + filename};
+  }
+  unsigned cameras = unsigned(num_cameras);
+  std::array<float, 6> bounds{{bbox.getPMin()[0], bbox.getPMin()[1], bbox.getPMin()[2],
+                               bbox.getPMax()[0], bbox.getPMax()[1], bbox.getPMax()[2]}};
+  fwrite(&validity_magic, sizeof(unsigned), 1, file_output);
+  fwrite(&cameras, sizeof(unsigned), 1, file_output);
+  fwrite(bounds.data(), sizeof(float), bounds.size(), file_output);
+  fwrite(&valid.res().x, sizeof(unsigned), 3, file_output);
+  fwrite(valid.volume().data(), sizeof(std::uint8_t), valid.volume().size(), file_output);
+  fclose(file_output);
+}
+
+bool readValidityVolume(std::string const& filename,
+                        gloost::BoundingBox const& bbox,
+                        std::size_t num_cameras,
+                        glm::uvec3 const& res,
+                        CalibrationVolume<std::uint8_t>& valid) {
+  FILE* file_input = fopen(filename.c_str(), "rb");
+  if (!file_input) {
+    return false;
+  }
+  unsigned magic = 0;
+  unsigned cameras = 0;
+  std::array<float, 6> bounds{};
+  glm::uvec3 res_file{0};
+  bool matches = fread(&magic, sizeof(unsigned), 1, file_input) == 1 && magic == validity_magic
+              && fread(&cameras, sizeof(unsigned), 1, file_input) == 1 && cameras == num_cameras
+              && fread(bounds.data(), sizeof(float), bounds.size(), file_input) == bounds.size()
+              && fread(&res_file.x, sizeof(unsigned), 3, file_input) == 3 && res_file == res;
+  for (unsigned i = 0; i < 3 && matches; ++i) {
+    matches = bounds[i] == bbox.getPMin()[i] && bounds[i + 3] == bbox.getPMax()[i];
+  }
+  std::vector<std::uint8_t> masks{};
+  if (matches) {
+    masks.resize(std::size_t(res.x) * res.y * res.z);
+    matches = fread(masks.data(), sizeof(std::uint8_t), masks.size(), file_input) == masks.size();
+  }
+  fclose(file_input);
+  if (matches) {
+    valid = CalibrationVolume<std::uint8_t>{res, glm::fvec2{0.0f}, masks};
+  }
+  return matches;
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef KINECT_VALIDITY_VOLUME_HPP
+#define KINECT_VALIDITY_VOLUME_HPP
+
+#include "calibration_volume.hpp"
+#include "frustum.hpp"
+
+#include "gloost/BoundingBox.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace kinect{
+
+// bit i of a voxel is set when its center lies in the frustum of camera i
+CalibrationVolume<std::uint8_t> computeValidityVolume(std::vector<Frustum> const& frustums,
+                                                      gloost::BoundingBox const& bbox,
+                                                      glm::uvec3 const& res);
+
+// linear indices of the bricks containing a valid voxel, dilated by one brick
+std::vector<unsigned> computeVisibleBricks(CalibrationVolume<std::uint8_t> const& valid, unsigned brick_size);
+
+// mask with the bits of all cameras set
+std::uint8_t allCameras(std::size_t num_cameras);
+
+// the header records the bbox and camera count the mask was computed for
+void writeValidityVolume(std::string const& filename,
+                         CalibrationVolume<std::uint8_t> const& valid,
+                         gloost::BoundingBox const& bbox,
+                         std::size_t num_cameras);
+
+// false if the file is missing or was written for another bbox, camera count or resolution
+bool readValidityVolume(std::string const& filename,
+                        gloost::BoundingBox const& bbox,
+                        std::size_t num_cameras,
+                        glm::uvec3 const& res,
+                        CalibrationVolume<std::uint8_t>& valid);
+
+}
+
+#endif // #ifndef KINECT_VALIDITY_VOLUME_HPP
@@ -0,0 +1,148 @@
+#include "volume_encoding.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace kinect{
+
+std::string toString(VolumeEncoding encoding) {
+  switch(encoding) {
+    case VolumeEncoding::FLOAT:
+      return "float";
+    case VolumeEncoding::HALF:
+      return "half residual";
+    case VolumeEncoding::UNORM16:
+      return "unorm16 residual";
+  }
+  return "unknown";
+}
+
+glm::fvec4 pinholeBasis(glm::fvec3 const& coords, glm::fvec2 const& depth_limits) {
+  float z = depth_limits.x + coords.z * (depth_limits.y - depth_limits.x);
+  return glm::fvec4{coords.x * z, coords.y * z, z, 1.0f};
+}
+
+glm::fmat4 pinholeMatrix(glm::fvec4 const& intrinsics) {
+  // x = (u - cx) * z / fx, y = (v - cy) * z / fy
+  glm::fmat4 mat{1.0f};
+  mat[0][0] = 1.0f / intrinsics.x;
+  mat[1][1] = 1.0f / intrinsics.y;
+  mat[2][0] = -intrinsics.z / intrinsics.x;
+  mat[2][1] = -intrinsics.w / intrinsics.y;
+  return mat;
+}
+
+glm::fvec3 voxelCoords(glm::uvec3 const& res, std::size_t index) {
+  unsigned x = index % res.x;
+  unsigned y = (index / res.x) % res.y;
+  unsigned z = index / (res.x * res.y);
+  return (glm::fvec3{x, y, z} + glm::fvec3{0.5f}) / glm::fvec3{res};
+}
+
+// least squares fit of value = A * pos_camera
+static glm::fmat4 fitAffine(std::vector<float> const& values, unsigned channels,
+                            glm::uvec3 const& res, glm::fvec2 const& depth_limits,
+                            glm::fmat4 const& pinhole) {
+  glm::dmat4 normal{0.0};
+  glm::dmat4 rhs{0.0};
+  std::size_t num_voxels = std::size_t(res.x) * res.y * res.z;
+  for(std::size_t i = 0; i < num_voxels; ++i) {
+    glm::dvec4 pos{pinhole * pinholeBasis(voxelCoords(res, i), depth_limits)};
+    normal += glm::outerProduct(pos, pos);
+    for(unsigned c = 0; c < channels; ++c) {
+      rhs[c] += pos * double(values[i * channels + c]);
+    }
+  }
+  glm::dmat4 normal_inv{glm::inverse(normal)};
+  glm::fmat4 affine{0.0f};
+  for(unsigned c = 0; c < channels; ++c) {
+    glm::dvec4 coeffs{normal_inv * rhs[c]};
+    for(unsigned j = 0; j < 4; ++j) {
+      affine[j][c] = float(coeffs[j]);
+    }
+  }
+  return affine;
+}
+
+EncodedVolume encodeVolume(std::vector<float> const& values, unsigned channels,
+                           glm::uvec3 const& res, glm::fvec2 const& depth_limits,
+                           glm::fvec4 const& intrinsics, VolumeEncoding encoding) {
+  if (encoding == VolumeEncoding::FLOAT) {
+    throw std::invalid_argument{"float volumes are not encoded"};
+  }
+  glm::fmat4 pinhole{pinholeMatrix(intrinsics)};
+  EncodedVolume volume{};
+  volume.res = res;
+  volume.channels = channels;
+  volume.model = fitAffine(values, channels, res, depth_limits, pinhole) * pinhole;
+  volume.scale = glm::fvec4{1.0f};
+
+  std::size_t num_voxels = std::size_t(res.x) * res.y * res.z;
+  std::vector<float> residuals(values.size());
+  glm::fvec4 res_min{std::numeric_limits<float>::max()};
+  glm::fvec4 res_max{std::numeric_limits<float>::lowest()};
+  for(std::size_t i = 0; i < num_voxels; ++i) {
+    glm::fvec4 modeled{volume.model * pinholeBasis(voxelCoords(res, i), depth_limits)};
+    for(unsigned c = 0; c < channels; ++c) {
+      float residual = values[i * channels + c] - modeled[c];
+      residuals[i * channels + c] = residual;
+      res_min[c] = std::min(res_min[c], residual);
+      res_max[c] = std::max(res_max[c], residual);
+    }
+  }
+
+  if (encoding == VolumeEncoding::UNORM16) {
+    for(unsigned c = 0; c < channels; ++c) {
+      float range = res_max[c] - res_min[c];
+      volume.scale[c] = range > 0.0f ? range : 1.0f;
+      // offset is applied through the translation of the model
+      volume.model[3][c] += res_min[c];
+    }
+  }
+
+  volume.data.resize(values.size());
+  double sum_sq_error = 0.0;
+  float max_error = 0.0f;
+  #pragma omp parallel for reduction(+:sum_sq_error) reduction(max:max_error)
+  for(std::size_t i = 0; i < values.size(); ++i) {
+    unsigned c = i % channels;
+    float decoded = 0.0f;
+    if (encoding == VolumeEncoding::HALF) {
+      volume.data[i] = glm::packHalf1x16(residuals[i]);
+      decoded = glm::unpackHalf1x16(volume.data[i]);
+    }
+    else {
+      volume.data[i] = glm::packUnorm1x16((residuals[i] - res_min[c]) / volume.scale[c]);
+      decoded = glm::unpackUnorm1x16(volume.data[i]) * volume.scale[c] + res_min[c];
+    }
+    float error = std::abs(decoded - residuals[i]);
+    max_error = std::max(max_error, error);
+    sum_sq_error += double(error) * error;
+  }
+  volume.max_error = max_error;
+  volume.rms_error = float(std::sqrt(sum_sq_error / double(values.size())));
+
+  return volume;
+}
+
+std::vector<std::int16_t> encodeInverseVolume(std::vector<glm::fvec4> const& values, float& max_error) {
+  std::vector<std::int16_t> data(values.size() * 3);
+  float error_max = 0.0f;
+  #pragma omp parallel for reduction(max:error_max)
+  for(std::size_t i = 0; i < values.size(); ++i) {
+    for(unsigned c = 0; c < 3; ++c) {
+      std::uint16_t packed = glm::packSnorm1x16(values[i][c]);
+      data[i * 3 + c] = std::int16_t(packed);
+      error_max = std::max(error_max, std::abs(glm::unpackSnorm1x16(packed) - values[i][c]));
+    }
+  }
+  max_error = error_max;
+  return data;
+}
+
+}
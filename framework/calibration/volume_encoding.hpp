@@ -0,0 +1,52 @@
+#ifndef KINECT_VOLUME_ENCODING_HPP
+#define KINECT_VOLUME_ENCODING_HPP
+
+#include <glm/gtc/type_precision.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace kinect{
+
+enum class VolumeEncoding {
+  FLOAT,   // full 32bit float values, no model
+  HALF,    // 16bit float residual against the pinhole model
+  UNORM16  // 16bit normalized residual against the pinhole model
+};
+
+std::string toString(VolumeEncoding encoding);
+
+// calibration volume stored as quantized residual against a per-camera model
+// value(coords) = residual(coords) * scale + model * pinholeBasis(coords)
+struct EncodedVolume {
+  glm::uvec3 res;
+  unsigned channels;
+  glm::fmat4 model;
+  glm::fvec4 scale;
+  std::vector<std::uint16_t> data;
+  // reconstruction error over all voxels, bounds trilinear lookups as well
+  float max_error;
+  float rms_error;
+};
+
+// lookup coords of the voxel center, x varies fastest
+glm::fvec3 voxelCoords(glm::uvec3 const& res, std::size_t index);
+
+// (u * z, v * z, z, 1) of a volume lookup, multilinear in the texture coords
+glm::fvec4 pinholeBasis(glm::fvec3 const& coords, glm::fvec2 const& depth_limits);
+// maps the basis to camera space, intrinsics are normalized to texture space
+glm::fmat4 pinholeMatrix(glm::fvec4 const& intrinsics);
+
+// fits the affine camera-to-value mapping in the least squares sense
+// and quantizes the residual, values are interleaved with given channels
+EncodedVolume encodeVolume(std::vector<float> const& values, unsigned channels,
+                           glm::uvec3 const& res, glm::fvec2 const& depth_limits,
+                           glm::fvec4 const& intrinsics, VolumeEncoding encoding);
+
+// inverse volumes hold normalized texture coordinates or -1 for invalid voxels
+std::vector<std::int16_t> encodeInverseVolume(std::vector<glm::fvec4> const& values, float& max_error);
+
+}
+
+#endif // #ifndef KINECT_VOLUME_ENCODING_HPP
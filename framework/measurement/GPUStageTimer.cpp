@@ -0,0 +1,75 @@
+#include "GPUStageTimer.h"
+
+#include <glbinding/gl/gl.h>
+using namespace gl;
+
+namespace sensor{
+
+
+  GPUStageTimer::GPUStageTimer()
+    : m_stages(),
+      m_times()
+  {}
+
+  GPUStageTimer::~GPUStageTimer(){
+    for(auto& stage : m_stages){
+      glDeleteQueries(2, stage.queries);
+    }
+  }
+
+
+  GPUStageTimer::Stage&
+  GPUStageTimer::stage(std::string const& name){
+    for(unsigned i = 0; i < m_stages.size(); ++i){
+      if(m_stages[i].name == name){
+        return m_stages[i];
+      }
+    }
+    m_stages.push_back(Stage{name, {0, 0}, false});
+    glGenQueries(2, m_stages.back().queries);
+    m_times.emplace_back(name, 0.0);
+    return m_stages.back();
+  }
+
+
+  void
+  GPUStageTimer::start(std::string const& name){
+    Stage& curr = stage(name);
+    // previous result is dropped if it did not arrive yet
+    glQueryCounter(curr.queries[0], GL_TIMESTAMP);
+    curr.pending = false;
+  }
+
+
+  void
+  GPUStageTimer::stop(std::string const& name){
+    Stage& curr = stage(name);
+    glQueryCounter(curr.queries[1], GL_TIMESTAMP);
+    curr.pending = true;
+  }
+
+
+  std::vector<std::pair<std::string, double>> const&
+  GPUStageTimer::get(){
+    for(unsigned i = 0; i < m_stages.size(); ++i){
+      Stage& curr = m_stages[i];
+      if(!curr.pending){
+        continue;
+      }
+      GLuint available = 0;
+      glGetQueryObjectuiv(curr.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if(!available){
+        continue;
+      }
+      GLuint64 time_start = 0;
+      GLuint64 time_stop = 0;
+      glGetQueryObjectui64v(curr.queries[0], GL_QUERY_RESULT, &time_start);
+      glGetQueryObjectui64v(curr.queries[1], GL_QUERY_RESULT, &time_stop);
+      m_times[i].second = (time_stop - time_start) * 1e-6;
+      curr.pending = false;
+    }
+    return m_times;
+  }
+
+
+}
@@ -0,0 +1,54 @@
+#ifndef GPUSTAGETIMER_H
+#define GPUSTAGETIMER_H
+
+#include <glbinding/gl/types.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+    timestamp based, so stages may nest inside a running GPUTimer
+    results are read when available, without stalling the pipeline
+
+    m_timer.start("integrate");
+    ...
+    m_timer.stop("integrate");
+    auto stages = m_timer.get();
+*/
+
+namespace sensor{
+
+  class GPUStageTimer{
+
+  public:
+    GPUStageTimer();
+    ~GPUStageTimer();
+
+    void start(std::string const& stage);
+    void stop(std::string const& stage);
+
+    // milliseconds of the stages, in order of their first start
+    std::vector<std::pair<std::string, double>> const& get();
+
+
+  protected:
+    struct Stage {
+      std::string name;
+      gl::GLuint  queries[2];
+      bool        pending;
+    };
+
+    Stage& stage(std::string const& name);
+
+    std::vector<Stage>                          m_stages;
+    std::vector<std::pair<std::string, double>> m_times;
+
+  };
+
+
+}
+
+
+
+#endif // #ifndef GPUSTAGETIMER_H
@@ -0,0 +1,236 @@
+#include "cpu_integrator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace kinect{
+
+namespace {
+// texel indices and weight of linear filtering along one axis
+struct Lerp {
+  unsigned i0;
+  unsigned i1;
+  float t;
+};
+
+inline Lerp lerpCoords(float coord, unsigned res) {
+  float pos = std::min(std::max(coord * float(res) - 0.5f, 0.0f), float(res - 1));
+  unsigned i0 = unsigned(pos);
+  return Lerp{i0, std::min(i0 + 1, res - 1), pos - float(i0)};
+}
+
+float sampleLinear(std::vector<float> const& volume, glm::uvec3 const& res, glm::fvec3 const& coords) {
+  Lerp lx{lerpCoords(coords.x, res.x)};
+  Lerp ly{lerpCoords(coords.y, res.y)};
+  Lerp lz{lerpCoords(coords.z, res.z)};
+  auto texel = [&](unsigned x, unsigned y, unsigned z) {
+    return volume[(std::size_t(z) * res.y + y) * res.x + x];
+  };
+  float c00 = texel(lx.i0, ly.i0, lz.i0) * (1.0f - lx.t) + texel(lx.i1, ly.i0, lz.i0) * lx.t;
+  float c10 = texel(lx.i0, ly.i1, lz.i0) * (1.0f - lx.t) + texel(lx.i1, ly.i1, lz.i0) * lx.t;
+  float c01 = texel(lx.i0, ly.i0, lz.i1) * (1.0f - lx.t) + texel(lx.i1, ly.i0, lz.i1) * lx.t;
+  float c11 = texel(lx.i0, ly.i1, lz.i1) * (1.0f - lx.t) + texel(lx.i1, ly.i1, lz.i1) * lx.t;
+  return (c00 * (1.0f - ly.t) + c10 * ly.t) * (1.0f - lz.t) + (c01 * (1.0f - ly.t) + c11 * ly.t) * lz.t;
+}
+
+float sampleLinear(std::vector<float> const& image, glm::uvec2 const& res, glm::fvec2 const& coords) {
+  return sampleLinear(image, glm::uvec3{res, 1}, glm::fvec3{coords, 0.5f});
+}
+}
+
+CpuIntegrator::CpuIntegrator(std::vector<CalibrationVolume<glm::fvec4>> const& volumes_inv,
+                             CalibrationVolume<std::uint8_t> const& volume_valid,
+                             glm::uvec3 const& res_tsdf, float limit)
+ :m_inv_x(volumes_inv.size())
+ ,m_inv_y(volumes_inv.size())
+ ,m_inv_z(volumes_inv.size())
+ ,m_res_inv{volumes_inv.empty() ? glm::uvec3{0} : volumes_inv[0].res()}
+ ,m_volume_valid{volume_valid}
+ ,m_res_tsdf{res_tsdf}
+ ,m_limit{limit}
+ ,m_tsdf(std::size_t(res_tsdf.x) * res_tsdf.y * res_tsdf.z, limit)
+{
+  if (volumes_inv.size() > 8) {
+    throw std::invalid_argument{"cpu integration supports at most 8 cameras"};
+  }
+  if (m_volume_valid.res() != m_res_inv) {
+    throw std::invalid_argument{"validity volume resolution does not match the inverse volumes"};
+  }
+  for(std::size_t i = 0; i < volumes_inv.size(); ++i) {
+    auto const& volume = volumes_inv[i].volume();
+    m_inv_x[i].resize(volume.size());
+    m_inv_y[i].resize(volume.size());
+    m_inv_z[i].resize(volume.size());
+    for(std::size_t v = 0; v < volume.size(); ++v) {
+      m_inv_x[i][v] = volume[v].x;
+      m_inv_y[i][v] = volume[v].y;
+      m_inv_z[i][v] = volume[v].z;
+    }
+  }
+}
+
+void CpuIntegrator::integrate(std::vector<std::vector<float>> const& depths,
+                              std::vector<std::vector<float>> const& qualities,
+                              glm::uvec2 const& res_depth) {
+  if (depths.size() != m_inv_x.size() || qualities.size() != m_inv_x.size()) {
+    throw std::invalid_argument{"need one depth and quality image per camera"};
+  }
+  unsigned const num_cameras = unsigned(m_inv_x.size());
+  glm::uvec3 const res{m_res_tsdf};
+  glm::uvec3 const res_inv{m_res_inv};
+  std::size_t const slice_inv = std::size_t(res_inv.x) * res_inv.y;
+  float const limit = m_limit;
+
+  // filter coordinates along x are the same for every row
+  std::vector<unsigned> x0(res.x), x1(res.x), x_valid(res.x);
+  std::vector<float> tx(res.x);
+  for(unsigned x = 0; x < res.x; ++x) {
+    float coord = (float(x) + 0.5f) / float(res.x);
+    Lerp lerp{lerpCoords(coord, res_inv.x)};
+    x0[x] = lerp.i0;
+    x1[x] = lerp.i1;
+    tx[x] = lerp.t;
+    x_valid[x] = std::min(unsigned(coord * float(res_inv.x)), res_inv.x - 1);
+  }
+
+  // slabs of rows, the row loops vectorize
+  #pragma omp parallel
+  {
+    std::vector<float> pos_x(res.x), pos_y(res.x), pos_z(res.x);
+    std::vector<float> weighted_tsd(res.x), weight(res.x);
+    std::vector<std::uint8_t> valid(res.x);
+
+    #pragma omp for schedule(static)
+    for(int z = 0; z < int(res.z); ++z) {
+      float coord_z = (float(z) + 0.5f) / float(res.z);
+      Lerp lerp_z{lerpCoords(coord_z, res_inv.z)};
+      unsigned z_valid = std::min(unsigned(coord_z * float(res_inv.z)), res_inv.z - 1);
+      for(unsigned y = 0; y < res.y; ++y) {
+        float coord_y = (float(y) + 0.5f) / float(res.y);
+        Lerp lerp_y{lerpCoords(coord_y, res_inv.y)};
+        unsigned y_valid = std::min(unsigned(coord_y * float(res_inv.y)), res_inv.y - 1);
+        // offsets of the four x rows touched by the filter
+        std::size_t const r00 = lerp_z.i0 * slice_inv + std::size_t(lerp_y.i0) * res_inv.x;
+        std::size_t const r10 = lerp_z.i0 * slice_inv + std::size_t(lerp_y.i1) * res_inv.x;
+        std::size_t const r01 = lerp_z.i1 * slice_inv + std::size_t(lerp_y.i0) * res_inv.x;
+        std::size_t const r11 = lerp_z.i1 * slice_inv + std::size_t(lerp_y.i1) * res_inv.x;
+        float const ty = lerp_y.t;
+        float const tz = lerp_z.t;
+
+        std::uint8_t const* row_valid = &m_volume_valid(0, y_valid, z_valid);
+        for(unsigned x = 0; x < res.x; ++x) {
+          valid[x] = row_valid[x_valid[x]];
+          weighted_tsd[x] = limit;
+          weight[x] = 0.0f;
+        }
+
+        for(unsigned i = 0; i < num_cameras; ++i) {
+          float const* inv_x = m_inv_x[i].data();
+          float const* inv_y = m_inv_y[i].data();
+          float const* inv_z = m_inv_z[i].data();
+          #pragma omp simd
+          for(unsigned x = 0; x < res.x; ++x) {
+            float const t = tx[x];
+            float const wx[2] = {1.0f - t, t};
+            std::size_t const xs[2] = {x0[x], x1[x]};
+            float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+            for(unsigned k = 0; k < 2; ++k) {
+              float const w00 = wx[k] * (1.0f - ty) * (1.0f - tz);
+              float const w10 = wx[k] * ty * (1.0f - tz);
+              float const w01 = wx[k] * (1.0f - ty) * tz;
+              float const w11 = wx[k] * ty * tz;
+              sx += inv_x[r00 + xs[k]] * w00 + inv_x[r10 + xs[k]] * w10 + inv_x[r01 + xs[k]] * w01 + inv_x[r11 + xs[k]] * w11;
+              sy += inv_y[r00 + xs[k]] * w00 + inv_y[r10 + xs[k]] * w10 + inv_y[r01 + xs[k]] * w01 + inv_y[r11 + xs[k]] * w11;
+              sz += inv_z[r00 + xs[k]] * w00 + inv_z[r10 + xs[k]] * w10 + inv_z[r01 + xs[k]] * w01 + inv_z[r11 + xs[k]] * w11;
+            }
+            pos_x[x] = sx;
+            pos_y[x] = sy;
+            pos_z[x] = sz;
+          }
+
+          float const* depth = depths[i].data();
+          float const* quality = qualities[i].data();
+          std::uint8_t const bit = std::uint8_t(1u << i);
+          #pragma omp simd
+          for(unsigned x = 0; x < res.x; ++x) {
+            // bilinear lookup with clamp to edge
+            float const u = std::min(std::max(pos_x[x] * float(res_depth.x) - 0.5f, 0.0f), float(res_depth.x - 1));
+            float const v = std::min(std::max(pos_y[x] * float(res_depth.y) - 0.5f, 0.0f), float(res_depth.y - 1));
+            unsigned const u0 = unsigned(u);
+            unsigned const v0 = unsigned(v);
+            unsigned const u1 = std::min(u0 + 1, res_depth.x - 1);
+            unsigned const v1 = std::min(v0 + 1, res_depth.y - 1);
+            float const tu = u - float(u0);
+            float const tv = v - float(v0);
+            std::size_t const p00 = std::size_t(v0) * res_depth.x + u0;
+            std::size_t const p10 = std::size_t(v0) * res_depth.x + u1;
+            std::size_t const p01 = std::size_t(v1) * res_depth.x + u0;
+            std::size_t const p11 = std::size_t(v1) * res_depth.x + u1;
+            float const d = (depth[p00] * (1.0f - tu) + depth[p10] * tu) * (1.0f - tv)
+                          + (depth[p01] * (1.0f - tu) + depth[p11] * tu) * tv;
+            float const sdist = d - pos_z[x];
+            bool const in_band = (valid[x] & bit) && sdist > -limit && sdist < limit;
+            float const lateral_quality = (quality[p00] * (1.0f - tu) + quality[p10] * tu) * (1.0f - tv)
+                                        + (quality[p01] * (1.0f - tu) + quality[p11] * tu) * tv;
+            float const q = in_band ? lateral_quality / (pos_z[x] * 4.0f + 0.5f) : 0.0f;
+            float const tsd = std::min(std::max(sdist, -limit), limit);
+            float const w = weight[x] + q;
+            weighted_tsd[x] = in_band ? (weighted_tsd[x] * weight[x] + q * tsd) / w : weighted_tsd[x];
+            weight[x] = w;
+          }
+        }
+        std::copy(weighted_tsd.begin(), weighted_tsd.end(), m_tsdf.begin() + (std::size_t(z) * res.y + y) * res.x);
+      }
+    }
+  }
+}
+
+std::vector<float> CpuIntegrator::integrateReference(std::vector<std::vector<float>> const& depths,
+                                                     std::vector<std::vector<float>> const& qualities,
+                                                     glm::uvec2 const& res_depth) const {
+  if (depths.size() != m_inv_x.size() || qualities.size() != m_inv_x.size()) {
+    throw std::invalid_argument{"need one depth and quality image per camera"};
+  }
+  std::vector<float> tsdf(m_tsdf.size(), m_limit);
+  #pragma omp parallel for
+  for(int z = 0; z < int(m_res_tsdf.z); ++z) {
+    for(unsigned y = 0; y < m_res_tsdf.y; ++y) {
+      for(unsigned x = 0; x < m_res_tsdf.x; ++x) {
+        glm::fvec3 pos_vol{(glm::fvec3{float(x), float(y), float(z)} + 0.5f) / glm::fvec3{m_res_tsdf}};
+        // nearest texel of the mask
+        glm::uvec3 texel_valid{glm::min(glm::uvec3{pos_vol * glm::fvec3{m_res_inv}}, m_res_inv - 1u)};
+        std::uint8_t valid = m_volume_valid(texel_valid.x, texel_valid.y, texel_valid.z);
+        float weighted_tsd = m_limit;
+        float weight = 0.0f;
+        for(unsigned i = 0; i < m_inv_x.size(); ++i) {
+          if (!(valid & (1u << i))) {
+            continue;
+          }
+          glm::fvec3 pos_calib{sampleLinear(m_inv_x[i], m_res_inv, pos_vol),
+                               sampleLinear(m_inv_y[i], m_res_inv, pos_vol),
+                               sampleLinear(m_inv_z[i], m_res_inv, pos_vol)};
+          glm::fvec2 coords{pos_calib.x, pos_calib.y};
+          float sdist = sampleLinear(depths[i], res_depth, coords) - pos_calib.z;
+          if (sdist > -m_limit && sdist < m_limit) {
+            float quality = sampleLinear(qualities[i], res_depth, coords) / (pos_calib.z * 4.0f + 0.5f);
+            weighted_tsd = (weighted_tsd * weight + quality * sdist) / (weight + quality);
+            weight += quality;
+          }
+        }
+        tsdf[(std::size_t(z) * m_res_tsdf.y + y) * m_res_tsdf.x + x] = weighted_tsd;
+      }
+    }
+  }
+  return tsdf;
+}
+
+std::vector<float> const& CpuIntegrator::tsdf() const {
+  return m_tsdf;
+}
+
+glm::uvec3 const& CpuIntegrator::res() const {
+  return m_res_tsdf;
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef KINECT_CPU_INTEGRATOR_HPP
+#define KINECT_CPU_INTEGRATOR_HPP
+
+#include "calibration_volume.hpp"
+
+#include <glm/gtc/type_precision.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace kinect{
+
+// tsdf integration of tsdf_integration.vs without a gl context
+// samples like linear filtering with clamp to edge, so results match up to the filtering precision of the gpu
+class CpuIntegrator{
+
+public:
+  CpuIntegrator(std::vector<CalibrationVolume<glm::fvec4>> const& volumes_inv,
+                CalibrationVolume<std::uint8_t> const& volume_valid,
+                glm::uvec3 const& res_tsdf, float limit);
+
+  // one filtered depth and quality image per camera, x varying fastest
+  void integrate(std::vector<std::vector<float>> const& depths,
+                 std::vector<std::vector<float>> const& qualities,
+                 glm::uvec2 const& res_depth);
+
+  // straightforward per voxel integration of the same frames, reference for the vectorized path
+  std::vector<float> integrateReference(std::vector<std::vector<float>> const& depths,
+                                        std::vector<std::vector<float>> const& qualities,
+                                        glm::uvec2 const& res_depth) const;
+
+  std::vector<float> const& tsdf() const;
+  glm::uvec3 const& res() const;
+
+private:
+  // planar copies of the inverse volumes for vectorized gathers
+  std::vector<std::vector<float>> m_inv_x;
+  std::vector<std::vector<float>> m_inv_y;
+  std::vector<std::vector<float>> m_inv_z;
+  glm::uvec3                      m_res_inv;
+  CalibrationVolume<std::uint8_t> m_volume_valid;
+
+  glm::uvec3         m_res_tsdf;
+  float              m_limit;
+  std::vector<float> m_tsdf;
+};
+
+}
+
+#endif // #ifndef KINECT_CPU_INTEGRATOR_HPP
@@ -0,0 +1,287 @@
+#include "marching_cubes.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <omp.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <stdexcept>
+
+namespace kinect{
+
+// corner c of a cell is offset by (c & 1, (c >> 1) & 1, (c >> 2) & 1)
+struct CaseTable {
+  // corners of the 12 cell edges, the second corner has the higher coordinate
+  std::array<std::array<unsigned, 2>, 12> edge_corners;
+  // edge triples of up to 5 triangles per inside mask, -1 terminated
+  std::array<std::array<int, 16>, 256> triangles;
+};
+
+// triangulation of every configuration from the face crossings instead of a hand written table
+// ambiguous faces always separate the outside corners, so neighbouring cells agree
+static CaseTable buildCaseTable() {
+  CaseTable table{};
+  std::array<std::array<int, 8>, 8> edge_index{};
+  unsigned num_edges = 0;
+  for(unsigned axis = 0; axis < 3; ++axis) {
+    for(unsigned a = 0; a < 8; ++a) {
+      if (!(a & (1u << axis))) {
+        unsigned b = a | (1u << axis);
+        table.edge_corners[num_edges] = {{a, b}};
+        edge_index[a][b] = num_edges;
+        edge_index[b][a] = num_edges;
+        ++num_edges;
+      }
+    }
+  }
+  // corners of each face, counter clockwise around the outward normal
+  std::array<std::array<unsigned, 4>, 6> faces{};
+  for(unsigned axis = 0; axis < 3; ++axis) {
+    unsigned u = 1u << ((axis + 1) % 3);
+    unsigned v = 1u << ((axis + 2) % 3);
+    for(unsigned side = 0; side < 2; ++side) {
+      unsigned base = side << axis;
+      std::array<unsigned, 4> corners{{base, base | u, base | u | v, base | v}};
+      if (side == 0) {
+        std::reverse(corners.begin(), corners.end());
+      }
+      faces[axis * 2 + side] = corners;
+    }
+  }
+
+  for(unsigned mask = 0; mask < 256; ++mask) {
+    auto inside = [mask](unsigned corner) {return (mask >> corner) & 1u;};
+    // each crossed edge starts one face segment and ends another
+    std::array<int, 12> next{};
+    next.fill(-1);
+    for(auto const& face : faces) {
+      for(unsigned k = 0; k < 4; ++k) {
+        if (!inside(face[k]) || inside(face[(k + 1) % 4])) {
+          continue;
+        }
+        for(unsigned j = 1; j < 4; ++j) {
+          unsigned a = face[(k + j) % 4];
+          unsigned b = face[(k + j + 1) % 4];
+          if (!inside(a) && inside(b)) {
+            next[edge_index[face[k]][face[(k + 1) % 4]]] = edge_index[a][b];
+            break;
+          }
+        }
+      }
+    }
+    auto& triangles = table.triangles[mask];
+    triangles.fill(-1);
+    unsigned num_indices = 0;
+    std::array<bool, 12> visited{};
+    for(int start = 0; start < 12; ++start) {
+      if (next[start] < 0 || visited[start]) {
+        continue;
+      }
+      std::vector<int> loop{};
+      for(int edge = start; !visited[edge]; edge = next[edge]) {
+        visited[edge] = true;
+        loop.push_back(edge);
+      }
+      // fan, reversed so triangles face the outside corners
+      for(std::size_t i = 1; i + 1 < loop.size(); ++i) {
+        triangles[num_indices++] = loop[0];
+        triangles[num_indices++] = loop[i + 1];
+        triangles[num_indices++] = loop[i];
+      }
+    }
+  }
+  return table;
+}
+
+static CaseTable const& caseTable() {
+  static CaseTable const table{buildCaseTable()};
+  return table;
+}
+
+// marks indices into the first vertex layer of the following chunk
+static unsigned const foreign_bit = 1u << 31;
+
+namespace {
+struct Chunk {
+  Mesh mesh;
+  unsigned z_begin;
+  unsigned z_end;
+};
+}
+
+Mesh extractMesh(std::vector<float> const& tsdf, glm::uvec3 const& res,
+                 glm::fmat4 const& vol_to_world,
+                 std::vector<glm::u8vec4> const& colors) {
+  if (tsdf.size() != std::size_t(res.x) * res.y * res.z) {
+    throw std::invalid_argument{"tsdf size does not match resolution"};
+  }
+  if (glm::any(glm::lessThan(res, glm::uvec3{2}))) {
+    return Mesh{};
+  }
+  CaseTable const& table = caseTable();
+  bool has_colors = !colors.empty();
+  glm::fmat3 normal_matrix{glm::inverseTranspose(glm::fmat3{vol_to_world})};
+  std::size_t slice = std::size_t(res.x) * res.y;
+  auto index = [&res, slice](unsigned x, unsigned y, unsigned z) {
+    return z * slice + std::size_t(y) * res.x + x;
+  };
+  auto gradient = [&](glm::uvec3 const& p) {
+    glm::uvec3 lo{glm::max(p, glm::uvec3{1}) - glm::uvec3{1}};
+    glm::uvec3 hi{glm::min(p + glm::uvec3{1}, res - glm::uvec3{1})};
+    return glm::fvec3{
+      (tsdf[index(hi.x, p.y, p.z)] - tsdf[index(lo.x, p.y, p.z)]) / float(hi.x - lo.x),
+      (tsdf[index(p.x, hi.y, p.z)] - tsdf[index(p.x, lo.y, p.z)]) / float(hi.y - lo.y),
+      (tsdf[index(p.x, p.y, hi.z)] - tsdf[index(p.x, p.y, lo.z)]) / float(hi.z - lo.z)
+    };
+  };
+
+  // slabs of cell layers, the vertices of an edge belong to the layer of its lower voxel
+  unsigned num_layers = res.z - 1;
+  unsigned num_chunks = std::min(num_layers, unsigned(omp_get_max_threads()) * 4);
+  std::vector<Chunk> chunks(num_chunks);
+  for(unsigned c = 0; c < num_chunks; ++c) {
+    chunks[c].z_begin = num_layers * c / num_chunks;
+    chunks[c].z_end = num_layers * (c + 1) / num_chunks;
+  }
+
+  #pragma omp parallel for schedule(dynamic)
+  for(unsigned c = 0; c < num_chunks; ++c) {
+    Mesh& mesh = chunks[c].mesh;
+    bool last_chunk = c + 1 == num_chunks;
+    // vertex per edge of a layer, x and y edges in the layer plane and z edges to the next
+    std::vector<unsigned> layer_prev(slice * 3, 0);
+    std::vector<unsigned> layer_curr(slice * 3, 0);
+    unsigned num_foreign = 0;
+
+    auto addVertex = [&](glm::uvec3 const& p, unsigned axis) {
+      glm::uvec3 q{p};
+      q[axis] += 1;
+      float v0 = tsdf[index(p.x, p.y, p.z)];
+      float v1 = tsdf[index(q.x, q.y, q.z)];
+      float t = v0 / (v0 - v1);
+      glm::fvec3 pos_voxel{p};
+      pos_voxel[axis] += t;
+      glm::fvec4 pos_world{vol_to_world * glm::fvec4{(pos_voxel + 0.5f) / glm::fvec3{res}, 1.0f}};
+      mesh.positions.push_back(glm::fvec3{pos_world} / pos_world.w);
+      // gradient in volume space, points to the positive side
+      glm::fvec3 grad{glm::mix(gradient(p), gradient(q), t) * glm::fvec3{res}};
+      mesh.normals.push_back(glm::normalize(normal_matrix * grad));
+      if (has_colors) {
+        glm::fvec4 color{glm::mix(glm::fvec4{colors[index(p.x, p.y, p.z)]}, glm::fvec4{colors[index(q.x, q.y, q.z)]}, t)};
+        mesh.colors.push_back(glm::u8vec4{color + 0.5f});
+      }
+      return unsigned(mesh.positions.size() - 1);
+    };
+    auto crosses = [&](glm::uvec3 const& p, unsigned axis) {
+      glm::uvec3 q{p};
+      q[axis] += 1;
+      return (tsdf[index(p.x, p.y, p.z)] < 0.0f) != (tsdf[index(q.x, q.y, q.z)] < 0.0f);
+    };
+
+    for(unsigned z = chunks[c].z_begin; z <= chunks[c].z_end; ++z) {
+      // the top plane of a slab is owned by the next one, which emits it first in the same order
+      bool foreign = z == chunks[c].z_end && !last_chunk;
+      for(unsigned y = 0; y < res.y; ++y) {
+        for(unsigned x = 0; x < res.x; ++x) {
+          for(unsigned axis = 0; axis < 2; ++axis) {
+            glm::uvec3 p{x, y, z};
+            if (p[axis] + 1 >= res[axis] || !crosses(p, axis)) {
+              continue;
+            }
+            unsigned& vertex = layer_curr[(std::size_t(y) * res.x + x) * 3 + axis];
+            vertex = foreign ? (foreign_bit | num_foreign++) : addVertex(p, axis);
+          }
+        }
+      }
+      if (z < chunks[c].z_end) {
+        for(unsigned y = 0; y < res.y; ++y) {
+          for(unsigned x = 0; x < res.x; ++x) {
+            glm::uvec3 p{x, y, z};
+            if (crosses(p, 2)) {
+              layer_curr[(std::size_t(y) * res.x + x) * 3 + 2] = addVertex(p, 2);
+            }
+          }
+        }
+      }
+      if (z > chunks[c].z_begin) {
+        // cells between the previous and current layer
+        unsigned zc = z - 1;
+        for(unsigned y = 0; y + 1 < res.y; ++y) {
+          for(unsigned x = 0; x + 1 < res.x; ++x) {
+            unsigned mask = 0;
+            for(unsigned corner = 0; corner < 8; ++corner) {
+              float value = tsdf[index(x + (corner & 1), y + ((corner >> 1) & 1), zc + ((corner >> 2) & 1))];
+              mask |= unsigned(value < 0.0f) << corner;
+            }
+            auto const& triangles = table.triangles[mask];
+            for(unsigned i = 0; i < 16 && triangles[i] >= 0; ++i) {
+              unsigned a = table.edge_corners[triangles[i]][0];
+              unsigned b = table.edge_corners[triangles[i]][1];
+              unsigned axis = (a ^ b) == 1 ? 0 : ((a ^ b) == 2 ? 1 : 2);
+              std::size_t cell = std::size_t(y + ((a >> 1) & 1)) * res.x + x + (a & 1);
+              std::vector<unsigned> const& layer = ((a >> 2) & 1) ? layer_curr : layer_prev;
+              mesh.indices.push_back(layer[cell * 3 + axis]);
+            }
+          }
+        }
+      }
+      std::swap(layer_prev, layer_curr);
+    }
+  }
+
+  // concatenate and resolve the references into the following slab
+  std::vector<std::size_t> offsets(num_chunks + 1, 0);
+  std::size_t num_indices = 0;
+  for(unsigned c = 0; c < num_chunks; ++c) {
+    offsets[c + 1] = offsets[c] + chunks[c].mesh.positions.size();
+    num_indices += chunks[c].mesh.indices.size();
+  }
+  Mesh mesh{};
+  mesh.positions.reserve(offsets.back());
+  mesh.normals.reserve(offsets.back());
+  mesh.colors.reserve(has_colors ? offsets.back() : 0);
+  mesh.indices.reserve(num_indices);
+  for(unsigned c = 0; c < num_chunks; ++c) {
+    Mesh const& chunk = chunks[c].mesh;
+    mesh.positions.insert(mesh.positions.end(), chunk.positions.begin(), chunk.positions.end());
+    mesh.normals.insert(mesh.normals.end(), chunk.normals.begin(), chunk.normals.end());
+    mesh.colors.insert(mesh.colors.end(), chunk.colors.begin(), chunk.colors.end());
+    for(unsigned vertex : chunk.indices) {
+      mesh.indices.push_back(unsigned(vertex & foreign_bit ? offsets[c + 1] + (vertex & ~foreign_bit) : offsets[c] + vertex));
+    }
+  }
+  return mesh;
+}
+
+void writePly(Mesh const& mesh, std::string const& filename) {
+  FILE* file_output = fopen(filename.c_str(), "wb");
+  if (!file_output) {
+    throw std::runtime_error{"could not open " + filename};
+  }
+  bool has_colors = mesh.colors.size() == mesh.positions.size();
+  fprintf(file_output, "ply\nformat binary_little_endian 1.0\n");
+  fprintf(file_output, "element vertex %zu\n", mesh.positions.size());
+  fprintf(file_output, "property float x\nproperty float y\nproperty float z\n");
+  fprintf(file_output, "property float nx\nproperty float ny\nproperty float nz\n");
+  if (has_colors) {
+    fprintf(file_output, "property uchar red\nproperty uchar green\nproperty uchar blue\n");
+  }
+  fprintf(file_output, "element face %zu\n", mesh.indices.size() / 3);
+  fprintf(file_output, "property list uchar int vertex_indices\nend_header\n");
+  for(std::size_t i = 0; i < mesh.positions.size(); ++i) {
+    fwrite(&mesh.positions[i], sizeof(glm::fvec3), 1, file_output);
+    fwrite(&mesh.normals[i], sizeof(glm::fvec3), 1, file_output);
+    if (has_colors) {
+      fwrite(&mesh.colors[i], sizeof(std::uint8_t), 3, file_output);
+    }
+  }
+  unsigned char const num_corners = 3;
+  for(std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    fwrite(&num_corners, sizeof(unsigned char), 1, file_output);
+    fwrite(&mesh.indices[i], sizeof(unsigned), 3, file_output);
+  }
+  fclose(file_output);
+}
+
+}
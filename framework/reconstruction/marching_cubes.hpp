@@ -0,0 +1,30 @@
+#ifndef KINECT_MARCHING_CUBES_HPP
+#define KINECT_MARCHING_CUBES_HPP
+
+#include <glm/gtc/type_precision.hpp>
+
+#include <string>
+#include <vector>
+
+namespace kinect{
+
+// indexed triangle mesh, one vertex per crossed voxel edge
+struct Mesh {
+  std::vector<glm::fvec3>  positions;
+  std::vector<glm::fvec3>  normals;
+  std::vector<glm::u8vec4> colors;
+  std::vector<unsigned>    indices;
+};
+
+// isosurface at zero of a tsdf with x varying fastest, colors are optional
+// positions are transformed from volume to world space, triangles face the positive side
+Mesh extractMesh(std::vector<float> const& tsdf, glm::uvec3 const& res,
+                 glm::fmat4 const& vol_to_world,
+                 std::vector<glm::u8vec4> const& colors = std::vector<glm::u8vec4>{});
+
+// binary little endian ply
+void writePly(Mesh const& mesh, std::string const& filename);
+
+}
+
+#endif // #ifndef KINECT_MARCHING_CUBES_HPP
@@ -29,6 +29,7 @@ ReconCalibs::ReconCalibs(CalibrationFiles const& cfs, CalibVolumes const* cv, gl
   m_program->setUniform("volume_tsdf", 29);
   m_program->setUniform("cv_xyz", m_cv->getXYZVolumeUnits());
   m_program->setUniform("cv_uv", m_cv->getUVVolumeUnits());
+  m_cv->setDecodeUniforms(m_program);
   m_program->setUniform("cv_xyz_inv", m_cv->getXYZVolumeUnitsInv());
 
   glm::fvec3 bbox_dimensions = glm::fvec3{m_bbox.getPMax()[0] - m_bbox.getPMin()[0],
@@ -39,6 +40,7 @@ ReconCalibs::ReconCalibs(CalibrationFiles const& cfs, CalibVolumes const* cv, gl
   auto vol_to_world(glm::scale(glm::fmat4{1.0f}, bbox_dimensions));
   vol_to_world = glm::translate(glm::fmat4{1.0f}, bbox_translation) * vol_to_world;
   m_program->setUniform("vol_to_world", vol_to_world);
+  m_program->setUniform("res_volume", m_sampler.dimensions());
 
   m_program->setUniform("limit", limit);
 }
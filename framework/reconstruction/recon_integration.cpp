@@ -4,6 +4,8 @@
 #include "unit_cube.hpp"
 #include <KinectCalibrationFile.h>
 #include "CalibVolumes.hpp"
+#include "validity_volume.hpp"
+#include <Timer.h>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/matrix_inverse.hpp>
@@ -11,21 +13,91 @@
 #include <globjects/Shader.h>
 #include <globjects/globjects.h>
 
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
 namespace kinect{
 
 static int start_image_unit = 3;
 static float limit = 0.01f;
 static float voxel_size = 0.007f;
+static unsigned brick_size = 8;
+static unsigned storage_binding_bricks = 2;
+static int weight_image_unit = 4;
+// surfaces only pass through a share of the visible bricks, the sparse pool holds that many
+static float pool_share = 0.25f;
+static unsigned storage_binding_hash = 3;
+static unsigned storage_binding_allocation = 4;
+static unsigned storage_binding_candidates = 5;
+static unsigned storage_binding_stats = 6;
+static unsigned storage_binding_ages = 13;
+static unsigned storage_binding_free = 14;
+// with temporal fusion bricks away from surfaces for this many frames are freed
+static unsigned evict_interval = 30;
+static unsigned max_brick_age = 30;
+static int minmax_image_unit = 5;
+static int minmax_texture_unit = 27;
+static int atlas_texture_unit = 28;
+static int tsdf_texture_unit = 29;
+static int steps_image_unit = 7;
+// only 8 image units are guaranteed, both are rebound every integration
+static int color_image_unit = 0;
+static int normal_image_unit = 1;
+static int color_texture_unit = 25;
+static int normal_texture_unit = 26;
+// finer levels nested in the base volume
+static unsigned max_nested = 3;
+static int nested_texture_unit = 36;
 
-ReconIntegration::ReconIntegration(CalibrationFiles const& cfs, CalibVolumes const* cv, gloost::BoundingBox const&  bbox)
+ReconIntegration::ReconIntegration(CalibrationFiles const& cfs, CalibVolumes const* cv, gloost::BoundingBox const&  bbox, bool sparse, unsigned levels)
  :Reconstruction(cfs, cv, bbox)
  ,m_program{new globjects::Program()}
  ,m_program_integration{new globjects::Program()}
+ ,m_program_compute{new globjects::Program()}
+ ,m_buffer_bricks{new globjects::Buffer()}
+ ,m_num_bricks{0}
+ ,m_use_compute{true}
+ ,m_sparse{sparse}
+ ,m_program_alloc{new globjects::Program()}
+ ,m_buffer_candidates{new globjects::Buffer()}
+ ,m_buffer_hash{new globjects::Buffer()}
+ ,m_buffer_allocation{new globjects::Buffer()}
+ ,m_num_candidates{0}
+ ,m_pool_res{0}
+ ,m_program_evict{new globjects::Program()}
+ ,m_buffer_ages{new globjects::Buffer()}
+ ,m_buffer_free{new globjects::Buffer()}
+ ,m_frame_alloc{0}
+ ,m_program_minmax{new globjects::Program()}
+ ,m_volume_minmax{}
+ ,m_res_minmax{1}
+ ,m_levels_minmax{0}
+ ,m_skip_empty{!sparse}
+ ,m_collect_stats{false}
+ ,m_buffers_stats{{new globjects::Buffer(), new globjects::Buffer()}}
+ ,m_frame{0}
+ ,m_samples_per_ray{0.0f}
+ ,m_adaptive_steps{false}
+ ,m_write_steps{false}
+ ,m_image_steps{globjects::Texture::createDefault(GL_TEXTURE_2D)}
+ ,m_precomputed_shading{false}
+ ,m_volume_color{}
+ ,m_volume_normal{}
+ ,m_levels{sparse ? 1u : std::max(1u, std::min(levels, max_nested + 1))}
+ ,m_limit_base{limit * float(1u << (m_levels - 1))}
+ ,m_nested{}
  ,m_res_volume{glm::ceil(glm::fvec3{bbox.getPMax()[0] - bbox.getPMin()[0],
                                     bbox.getPMax()[1] - bbox.getPMin()[1],
-                                    bbox.getPMax()[2] - bbox.getPMin()[2]} / voxel_size)}
+                                    bbox.getPMax()[2] - bbox.getPMin()[2]} / (voxel_size * float(1u << (m_levels - 1))))}
  ,m_sampler{m_res_volume}
  ,m_volume_tsdf{}
+ ,m_volume_weight{}
+ ,m_temporal{false}
+ ,m_max_weight{20.0f}
+ ,m_motion_threshold{limit * 0.5f}
+ ,m_motion_decay{0.1f}
  ,m_mat_vol_to_world{1.0f}
 {
   m_program->attach(
@@ -42,12 +114,14 @@ ReconIntegration::ReconIntegration(CalibrationFiles const& cfs, CalibVolumes con
   m_mat_vol_to_world = glm::translate(glm::fmat4{1.0f}, bbox_translation) * m_mat_vol_to_world;
 
   m_program->setUniform("vol_to_world", m_mat_vol_to_world);
+  m_program->setUniform("Dimensions", bbox_dimensions);
   m_program->setUniform("kinect_colors",1);
   m_program->setUniform("kinect_depths",2);
   m_program->setUniform("kinect_qualities",3);
   m_program->setUniform("kinect_normals",4);
   m_program->setUniform("cv_xyz_inv", m_cv->getXYZVolumeUnitsInv());
   m_program->setUniform("cv_uv", m_cv->getUVVolumeUnits());
+  m_cv->setDecodeUniforms(m_program);
   m_program->setUniform("num_kinects", m_num_kinects);
   m_program->setUniform("limit", limit);
   
@@ -55,9 +129,10 @@ ReconIntegration::ReconIntegration(CalibrationFiles const& cfs, CalibVolumes con
     globjects::Shader::fromFile(GL_VERTEX_SHADER,   "glsl/tsdf_integration.vs")
   );
   m_program_integration->setUniform("cv_xyz_inv", m_cv->getXYZVolumeUnitsInv());
-  m_program->setUniform("volume_tsdf", 29);
+  m_program_integration->setUniform("cv_valid", m_cv->getValidityVolumeUnit());
 
   m_program_integration->setUniform("volume_tsdf", start_image_unit);
+  m_program_integration->setUniform("volume_weight", weight_image_unit);
   m_program_integration->setUniform("kinect_colors",1);
   m_program_integration->setUniform("kinect_depths",2);
   m_program_integration->setUniform("kinect_qualities",3);
@@ -65,23 +140,347 @@ ReconIntegration::ReconIntegration(CalibrationFiles const& cfs, CalibVolumes con
   m_program_integration->setUniform("num_kinects", m_num_kinects);
   m_program_integration->setUniform("res_depth", glm::uvec2{m_cf->getWidth(), m_cf->getHeight()});
   m_program_integration->setUniform("res_tsdf", m_res_volume);
-  m_program_integration->setUniform("limit", limit);
+  m_program_integration->setUniform("limit", m_limit_base);
 
-  m_volume_tsdf = globjects::Texture::createDefault(GL_TEXTURE_3D);
-  std::vector<float> empty_tsdf(m_res_volume.x * m_res_volume.y * m_res_volume.z, -limit);
-  m_volume_tsdf->image3D(0, GL_R32F, glm::ivec3{m_res_volume}, 0, GL_RED, GL_FLOAT, empty_tsdf.data());
-  m_volume_tsdf->bindActive(GL_TEXTURE0 + 29);
+  m_program_compute->attach(
+    globjects::Shader::fromFile(GL_COMPUTE_SHADER, "glsl/tsdf_integration.cs")
+  );
+  glm::uvec3 res_inv{m_cv->getVolumeRes()};
+  // footprint of a brick only fits the shared cache if the inverse volumes are not finer
+  bool cache_inv = glm::all(glm::lessThanEqual(res_inv, m_res_volume));
+  m_program_compute->setUniform("cv_xyz_inv", m_cv->getXYZVolumeUnitsInv());
+  m_program_compute->setUniform("cv_valid", m_cv->getValidityVolumeUnit());
+  m_program_compute->setUniform("volume_tsdf", start_image_unit);
+  m_program_compute->setUniform("volume_weight", weight_image_unit);
+  m_program_compute->setUniform("kinect_depths",2);
+  m_program_compute->setUniform("kinect_qualities",3);
+  m_program_compute->setUniform("num_kinects", m_num_kinects);
+  m_program_compute->setUniform("res_tsdf", m_res_volume);
+  m_program_compute->setUniform("res_inv", res_inv);
+  m_program_compute->setUniform("cache_inv", cache_inv ? 1u : 0u);
+  m_program_compute->setUniform("limit", m_limit_base);
+  m_program_compute->setUniform("level_min", glm::fvec3{0.0f});
+  m_program_compute->setUniform("level_size", glm::fvec3{1.0f});
+  m_program_compute->setUniform("sparse", m_sparse ? 1u : 0u);
+  m_program->setUniform("sparse", m_sparse ? 1u : 0u);
+  createBricks();
+
+  if (m_sparse) {
+    createSparseVolume();
+  }
+  else {
+    m_volume_tsdf = globjects::Texture::createDefault(GL_TEXTURE_3D);
+    // voxels seen by no camera are never written by the compute path, start outside the surface
+    std::vector<float> empty_tsdf(m_res_volume.x * m_res_volume.y * m_res_volume.z, m_limit_base);
+    m_volume_tsdf->image3D(0, GL_R32F, glm::ivec3{m_res_volume}, 0, GL_RED, GL_FLOAT, empty_tsdf.data());
+    m_program->setUniform("volume_tsdf", tsdf_texture_unit);
+
+    m_volume_weight = globjects::Texture::createDefault(GL_TEXTURE_3D);
+    std::vector<float> empty_weight(empty_tsdf.size(), 0.0f);
+    m_volume_weight->image3D(0, GL_R32F, glm::ivec3{m_res_volume}, 0, GL_RED, GL_FLOAT, empty_weight.data());
+    createMinMaxPyramid();
+  }
+  m_program->setUniform("num_nested", 0u);
+  if (m_levels > 1) {
+    std::vector<glm::fvec3> boxes_min{};
+    std::vector<glm::fvec3> boxes_max{};
+    computeSensorDistanceBoxes(boxes_min, boxes_max);
+    createNestedLevels(boxes_min, boxes_max);
+  }
+  updateFusionUniforms();
+
+  std::array<unsigned, 2> empty_stats{{0, 0}};
+  for (auto buffer : m_buffers_stats) {
+    buffer->setData(empty_stats, GL_DYNAMIC_READ);
+  }
+  m_program->setUniform("skip_empty", m_skip_empty ? 1u : 0u);
+  m_program->setUniform("collect_stats", 0u);
+  m_program->setUniform("adaptive_steps", 0u);
+  float depth_range = std::numeric_limits<float>::max();
+  for(unsigned i = 0; i < m_num_kinects; ++i) {
+    depth_range = std::min(depth_range, m_cv->getDepthLimits(i).y - m_cv->getDepthLimits(i).x);
+  }
+  m_program->setUniform("depth_range", depth_range);
+  m_program->setUniform("write_steps", 0u);
+  m_program->setUniform("step_counts", steps_image_unit);
+  m_program->setUniform("precomputed_shading", 0u);
+  m_program->setUniform("volume_color", color_texture_unit);
+  m_program->setUniform("volume_normal", normal_texture_unit);
+  for (auto program : {m_program_integration, m_program_compute}) {
+    program->setUniform("write_shading", 0u);
+    program->setUniform("write_tsdf", 1u);
+    program->setUniform("volume_color", color_image_unit);
+    program->setUniform("volume_normal", normal_image_unit);
+    program->setUniform("kinect_colors", 1);
+    program->setUniform("kinect_normals", 4);
+    program->setUniform("cv_uv", m_cv->getUVVolumeUnits());
+    m_cv->setDecodeUniforms(program);
+  }
+  m_image_steps->image2D(0, GL_R32UI, glm::ivec2{1}, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
 }
 
 ReconIntegration::~ReconIntegration() {
   m_program->destroy();
   m_program_integration->destroy();
+  m_program_compute->destroy();
+  m_buffer_bricks->destroy();
+  m_program_alloc->destroy();
+  m_buffer_candidates->destroy();
+  m_buffer_hash->destroy();
+  m_buffer_allocation->destroy();
+  m_program_evict->destroy();
+  m_buffer_ages->destroy();
+  m_buffer_free->destroy();
+  m_volume_tsdf->destroy();
+  m_volume_weight->destroy();
+  for (auto const& level : m_nested) {
+    level.volume_tsdf->destroy();
+    level.volume_weight->destroy();
+    level.buffer_bricks->destroy();
+  }
+}
+
+void ReconIntegration::createBricks() {
+  std::vector<Frustum> frustums{};
+  for(unsigned i = 0; i < m_num_kinects; ++i) {
+    frustums.push_back(m_cv->getFrustum(i));
+  }
+  std::vector<unsigned> bricks{computeVisibleBricks(computeValidityVolume(frustums, m_bbox, m_res_volume), brick_size)};
+  glm::uvec3 res_bricks{(m_res_volume + brick_size - 1u) / brick_size};
+  std::cout << bricks.size() << " of " << res_bricks.x * res_bricks.y * res_bricks.z << " bricks visible" << std::endl;
+  // sparse volumes integrate the allocated pool slots instead
+  if (m_sparse) {
+    m_num_candidates = bricks.size();
+    m_buffer_candidates->setData(bricks, GL_STATIC_DRAW);
+    // cubic atlas, at least the share of the visible bricks
+    m_pool_res = 1;
+    while (float(m_pool_res * m_pool_res * m_pool_res) < float(bricks.size()) * pool_share) {
+      ++m_pool_res;
+    }
+    m_num_bricks = m_pool_res * m_pool_res * m_pool_res;
+    m_buffer_bricks->setData(m_num_bricks * sizeof(unsigned), nullptr, GL_DYNAMIC_COPY);
+  }
+  else {
+    m_num_bricks = bricks.size();
+    m_buffer_bricks->setData(bricks, GL_STATIC_DRAW);
+  }
+  m_program_compute->setUniform("num_bricks", m_num_bricks);
+}
+
+void ReconIntegration::createSparseVolume() {
+  unsigned pool_size = m_pool_res * m_pool_res * m_pool_res;
+  // twice the pool size and a power of two
+  unsigned hash_size = 1;
+  while (hash_size < pool_size * 2) {
+    hash_size *= 2;
+  }
+  m_buffer_hash->setData(hash_size * 2 * sizeof(unsigned), nullptr, GL_DYNAMIC_COPY);
+  m_buffer_allocation->setData(4 * sizeof(unsigned), nullptr, GL_DYNAMIC_COPY);
+  m_buffer_ages->setData(pool_size * sizeof(unsigned), nullptr, GL_DYNAMIC_COPY);
+  m_buffer_free->setData(pool_size * sizeof(unsigned), nullptr, GL_DYNAMIC_COPY);
+  resetPool();
+
+  glm::ivec3 res_atlas{glm::uvec3{m_pool_res * brick_size}};
+  std::vector<float> empty_tsdf(res_atlas.x * res_atlas.y * res_atlas.z, limit);
+  m_volume_tsdf = globjects::Texture::createDefault(GL_TEXTURE_3D);
+  m_volume_tsdf->image3D(0, GL_R32F, res_atlas, 0, GL_RED, GL_FLOAT, empty_tsdf.data());
+  m_program->setUniform("volume_tsdf", atlas_texture_unit);
+
+  m_volume_weight = globjects::Texture::createDefault(GL_TEXTURE_3D);
+  std::vector<float> empty_weight(empty_tsdf.size(), 0.0f);
+  m_volume_weight->image3D(0, GL_R32F, res_atlas, 0, GL_RED, GL_FLOAT, empty_weight.data());
+
+  m_program_alloc->attach(
+    globjects::Shader::fromFile(GL_COMPUTE_SHADER, "glsl/tsdf_sparse_alloc.cs")
+  );
+  m_program_alloc->setUniform("cv_xyz_inv", m_cv->getXYZVolumeUnitsInv());
+  m_program_alloc->setUniform("cv_valid", m_cv->getValidityVolumeUnit());
+  m_program_alloc->setUniform("kinect_depths",2);
+  m_program_alloc->setUniform("num_kinects", m_num_kinects);
+  m_program_alloc->setUniform("num_candidates", m_num_candidates);
+  m_program_alloc->setUniform("res_tsdf", m_res_volume);
+  m_program_alloc->setUniform("pool_size", pool_size);
+  m_program_alloc->setUniform("hash_size", hash_size);
+  // a surface inside the brick is at most half a diagonal from a tested point
+  // depths are normalized to the range of each camera, so is the diagonal
+  float half_diagonal = glm::length(glm::fvec3{float(brick_size) * voxel_size}) * 0.5f;
+  std::vector<float> bands(5, 0.0f);
+  for(unsigned i = 0; i < m_num_kinects; ++i) {
+    glm::fvec2 depth_limits{m_cv->getDepthLimits(i)};
+    bands[i] = limit + half_diagonal / (depth_limits.y - depth_limits.x);
+  }
+  m_program_alloc->setUniform("band", bands);
+
+  m_program_evict->attach(
+    globjects::Shader::fromFile(GL_COMPUTE_SHADER, "glsl/tsdf_sparse_evict.cs")
+  );
+  m_program_evict->setUniform("volume_tsdf", start_image_unit);
+  m_program_evict->setUniform("volume_weight", weight_image_unit);
+  m_program_evict->setUniform("pool_res", m_pool_res);
+  m_program_evict->setUniform("hash_size", hash_size);
+  m_program_evict->setUniform("max_age", max_brick_age);
+  m_program_evict->setUniform("limit", limit);
+
+  m_program_compute->setUniform("pool_res", m_pool_res);
+  m_program->setUniform("res_tsdf", m_res_volume);
+  m_program->setUniform("pool_res", m_pool_res);
+  m_program->setUniform("hash_size", hash_size);
+
+  // tsdf and weight channel
+  float mb_dense = float(m_res_volume.x) * m_res_volume.y * m_res_volume.z * 2 * sizeof(float) / 1024.0f / 1024.0f;
+  float mb_pool = float(empty_tsdf.size()) * 2 * sizeof(float) / 1024.0f / 1024.0f;
+  std::cout << "sparse tsdf pool of " << pool_size << " bricks for " << m_num_candidates << " visible, "
+            << mb_pool << " MB instead of " << mb_dense << " MB dense for tsdf and weights" << std::endl;
+}
+
+void ReconIntegration::resetPool() {
+  m_buffer_hash->clearData(GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT);
+  // no free slots, the pool grows from the start
+  std::array<unsigned, 4> allocation{{0, 1, 1, 0}};
+  m_buffer_allocation->setSubData(0, sizeof(allocation), allocation.data());
+}
+
+void ReconIntegration::evictBricks() {
+  m_timer_stages.start("evict");
+  // rebuilt from the slots that are kept
+  m_buffer_hash->clearData(GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT);
+  m_volume_tsdf->bindImageTexture(start_image_unit, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+  m_volume_weight->bindImageTexture(weight_image_unit, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+  m_program_evict->use();
+  m_program_evict->setUniform("frame", m_frame_alloc);
+  m_buffer_hash->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_hash);
+  m_buffer_allocation->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_allocation);
+  m_buffer_bricks->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_bricks);
+  m_buffer_ages->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_ages);
+  m_buffer_free->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_free);
+  // one workgroup per allocated slot
+  m_buffer_allocation->bind(GL_DISPATCH_INDIRECT_BUFFER);
+  glDispatchComputeIndirect(0);
+  m_program_evict->release();
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  m_timer_stages.stop("evict");
+}
+
+void ReconIntegration::allocateBricks() {
+  // with history, stale bricks would hold their slots forever
+  if (m_temporal && m_frame_alloc % evict_interval == 0) {
+    evictBricks();
+  }
+  m_timer_stages.start("allocate");
+  // without history bricks only live for one frame
+  if (!m_temporal) {
+    resetPool();
+  }
+  m_program_alloc->use();
+  m_program_alloc->setUniform("frame", m_frame_alloc);
+  m_buffer_ages->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_ages);
+  m_buffer_free->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_free);
+  m_buffer_candidates->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_candidates);
+  m_buffer_hash->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_hash);
+  m_buffer_allocation->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_allocation);
+  m_buffer_bricks->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_bricks);
+  m_program_alloc->dispatchCompute((m_num_candidates + 63) / 64, 1, 1);
+  m_program_alloc->release();
+  // the slot count is read as dispatch size
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+  ++m_frame_alloc;
+  m_timer_stages.stop("allocate");
+}
+
+void ReconIntegration::createMinMaxPyramid() {
+  glm::uvec3 res_bricks{(m_res_volume + brick_size - 1u) / brick_size};
+  // power of two per axis so every node has exactly its children
+  for (unsigned i = 0; i < 3; ++i) {
+    while (m_res_minmax[i] < res_bricks[i]) {
+      m_res_minmax[i] *= 2;
+    }
+  }
+  unsigned res_max = std::max(m_res_minmax.x, std::max(m_res_minmax.y, m_res_minmax.z));
+  m_levels_minmax = 1;
+  while ((1u << (m_levels_minmax - 1)) < res_max) {
+    ++m_levels_minmax;
+  }
+  m_volume_minmax = globjects::Texture::createDefault(GL_TEXTURE_3D);
+  m_volume_minmax->storage3D(m_levels_minmax, GL_RG32F, glm::ivec3{m_res_minmax});
+  m_volume_minmax->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  m_volume_minmax->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  m_program_minmax->attach(
+    globjects::Shader::fromFile(GL_COMPUTE_SHADER, "glsl/tsdf_minmax.cs")
+  );
+  m_program_minmax->setUniform("volume_tsdf", tsdf_texture_unit);
+  m_program_minmax->setUniform("minmax_dst", minmax_image_unit);
+  m_program_minmax->setUniform("minmax_src", minmax_image_unit + 1);
+  m_program_minmax->setUniform("res_tsdf", m_res_volume);
+  m_program_minmax->setUniform("limit", m_limit_base);
+
+  m_program->setUniform("volume_minmax", minmax_texture_unit);
+  m_program->setUniform("levels_minmax", m_levels_minmax);
+  m_program->setUniform("res_tsdf", m_res_volume);
+}
+
+void ReconIntegration::updateMinMaxPyramid() {
+  m_timer_stages.start("minmax");
+  m_volume_tsdf->bindActive(GL_TEXTURE0 + tsdf_texture_unit);
+  m_program_minmax->use();
+  for (unsigned level = 0; level < m_levels_minmax; ++level) {
+    m_program_minmax->setUniform("level", level);
+    m_volume_minmax->bindImageTexture(minmax_image_unit, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
+    if (level == 0) {
+      // one workgroup per brick
+      m_program_minmax->dispatchCompute(m_res_minmax);
+    }
+    else {
+      m_volume_minmax->bindImageTexture(minmax_image_unit + 1, level - 1, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+      glm::uvec3 res_level{glm::max(m_res_minmax >> level, glm::uvec3{1})};
+      m_program_minmax->dispatchCompute((res_level + 7u) / 8u);
+    }
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+  m_program_minmax->release();
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  m_timer_stages.stop("minmax");
+}
+
+void ReconIntegration::createShadingVolumes() {
+  // 8 bit per channel, the blended values come from 8 bit textures
+  m_volume_color = globjects::Texture::createDefault(GL_TEXTURE_3D);
+  m_volume_color->image3D(0, GL_RGBA8, glm::ivec3{m_res_volume}, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  m_volume_normal = globjects::Texture::createDefault(GL_TEXTURE_3D);
+  m_volume_normal->image3D(0, GL_RGBA8_SNORM, glm::ivec3{m_res_volume}, 0, GL_RGBA, GL_BYTE, nullptr);
+  float mb = float(m_res_volume.x) * m_res_volume.y * m_res_volume.z * 8.0f / 1024.0f / 1024.0f;
+  std::cout << "shading volumes use " << mb << " MB" << std::endl;
+}
+
+void ReconIntegration::updateRaymarchStats() {
+  // previous frame is likely finished, avoids waiting for the current one
+  auto& buffer_prev = m_buffers_stats[(m_frame + 1) % 2];
+  std::array<unsigned, 2> stats = buffer_prev->getSubData<unsigned, 2>();
+  m_samples_per_ray = stats[0] > 0 ? float(stats[1]) / float(stats[0]) : 0.0f;
+
+  auto& buffer_curr = m_buffers_stats[m_frame % 2];
+  std::array<unsigned, 2> empty_stats{{0, 0}};
+  buffer_curr->setSubData(0, sizeof(empty_stats), empty_stats.data());
+  buffer_curr->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_stats);
+  ++m_frame;
 }
 
 void ReconIntegration::draw(){
   integrate();
 
+  m_timer_stages.start("raymarch");
+  bindTextures();
   m_program->use();
+  if (m_sparse) {
+    m_buffer_hash->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_hash);
+  }
+  if (m_collect_stats) {
+    updateRaymarchStats();
+  }
+  if (m_write_steps) {
+    m_image_steps->clearImage(0, GL_RED_INTEGER, GL_UNSIGNED_INT, glm::uvec4{0});
+    m_image_steps->bindImageTexture(steps_image_unit, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32UI);
+  }
 
   gloost::Matrix modelview;
   glGetFloatv(GL_MODELVIEW_MATRIX, modelview.data());
@@ -97,19 +496,399 @@ void ReconIntegration::draw(){
   UnitCube::draw();
 
   m_program->release();  
+  m_timer_stages.stop("raymarch");
+}
+
+void ReconIntegration::bindTextures() const {
+  // units are shared by all integration instances, only the drawn one may occupy them
+  m_volume_tsdf->bindActive(GL_TEXTURE0 + (m_sparse ? atlas_texture_unit : tsdf_texture_unit));
+  if (m_skip_empty) {
+    m_volume_minmax->bindActive(GL_TEXTURE0 + minmax_texture_unit);
+  }
+  if (m_precomputed_shading) {
+    m_volume_color->bindActive(GL_TEXTURE0 + color_texture_unit);
+    m_volume_normal->bindActive(GL_TEXTURE0 + normal_texture_unit);
+  }
+  for (unsigned l = 0; l < m_nested.size(); ++l) {
+    m_nested[l].volume_tsdf->bindActive(GL_TEXTURE0 + nested_texture_unit + l);
+  }
+}
+
+void ReconIntegration::resize(std::size_t width, std::size_t height) {
+  m_image_steps->image2D(0, GL_R32UI, glm::ivec2{width, height}, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
 }
 
 void ReconIntegration::integrate() {
-  
-  glEnable(GL_RASTERIZER_DISCARD);
-  m_program_integration->use();
+  if (m_sparse) {
+    allocateBricks();
+  }
+  m_volume_tsdf->bindImageTexture(start_image_unit, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+  m_volume_weight->bindImageTexture(weight_image_unit, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+  if (m_precomputed_shading) {
+    m_volume_color->bindImageTexture(color_image_unit, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    m_volume_normal->bindImageTexture(normal_image_unit, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8_SNORM);
+  }
+
+  if (m_sparse) {
+    m_timer_stages.start("integrate compute");
+    m_program_compute->use();
+    m_buffer_bricks->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_bricks);
+    m_buffer_allocation->bind(GL_DISPATCH_INDIRECT_BUFFER);
+    glDispatchComputeIndirect(0);
+    m_program_compute->release();
+    m_timer_stages.stop("integrate compute");
+  }
+  else if (m_use_compute) {
+    m_timer_stages.start("integrate compute");
+    m_program_compute->use();
+    m_buffer_bricks->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_bricks);
+    // stay below the minimum workgroup count limit per dimension
+    unsigned groups_x = std::min(m_num_bricks, 65535u);
+    unsigned groups_y = (m_num_bricks + groups_x - 1) / groups_x;
+    m_program_compute->dispatchCompute(groups_x, groups_y, 1);
+    m_program_compute->release();
+    m_timer_stages.stop("integrate compute");
+  }
+  else {
+    m_timer_stages.start("integrate vertex");
+    glEnable(GL_RASTERIZER_DISCARD);
+    m_program_integration->use();
+
+    m_sampler.sample();
+
+    m_program_integration->release();
+    glDisable(GL_RASTERIZER_DISCARD);
+    m_timer_stages.stop("integrate vertex");
+  }
+  if (!m_nested.empty()) {
+    integrateNested();
+  }
+  // raymarching samples the volume written as image
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
 
-  m_volume_tsdf->bindImageTexture(start_image_unit, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+  if (m_skip_empty) {
+    updateMinMaxPyramid();
+  }
+}
+
+void ReconIntegration::setComputeIntegration(bool enable) {
+  m_use_compute = enable;
+}
 
-  m_sampler.sample();
+bool ReconIntegration::isComputeIntegration() const {
+  return m_use_compute;
+}
+
+void ReconIntegration::setTemporalFusion(bool enable) {
+  // start without history, weights are stale after running per frame
+  if (enable && !m_temporal) {
+    m_volume_weight->clearImage(0, GL_RED, GL_FLOAT, glm::vec4{0.0f});
+    for (auto const& level : m_nested) {
+      level.volume_weight->clearImage(0, GL_RED, GL_FLOAT, glm::vec4{0.0f});
+    }
+    // slots were reused every frame and hold no history
+    if (m_sparse) {
+      resetPool();
+    }
+  }
+  m_temporal = enable;
+  updateFusionUniforms();
+}
 
-  m_program_integration->release();
-  glDisable(GL_RASTERIZER_DISCARD);
+bool ReconIntegration::isTemporalFusion() const {
+  return m_temporal;
 }
 
-}
\ No newline at end of file
+void ReconIntegration::setMaxWeight(float weight) {
+  m_max_weight = weight;
+  updateFusionUniforms();
+}
+
+void ReconIntegration::setMotionDecay(float threshold, float decay) {
+  m_motion_threshold = threshold;
+  m_motion_decay = decay;
+  updateFusionUniforms();
+}
+
+void ReconIntegration::updateFusionUniforms() {
+  for (auto program : {m_program_integration, m_program_compute}) {
+    program->setUniform("temporal", m_temporal ? 1u : 0u);
+    program->setUniform("max_weight", m_max_weight);
+    program->setUniform("motion_threshold", m_motion_threshold);
+    program->setUniform("motion_decay", m_motion_decay);
+  }
+}
+
+void ReconIntegration::setEmptySkipping(bool enable) {
+  // the pyramid is only built for dense volumes
+  m_skip_empty = enable && !m_sparse;
+  m_program->setUniform("skip_empty", m_skip_empty ? 1u : 0u);
+}
+
+bool ReconIntegration::isEmptySkipping() const {
+  return m_skip_empty;
+}
+
+void ReconIntegration::setRaymarchStats(bool enable) {
+  m_collect_stats = enable;
+  m_program->setUniform("collect_stats", m_collect_stats ? 1u : 0u);
+}
+
+float ReconIntegration::getSamplesPerRay() const {
+  return m_samples_per_ray;
+}
+
+void ReconIntegration::setAdaptiveSteps(bool enable) {
+  m_adaptive_steps = enable;
+  m_program->setUniform("adaptive_steps", m_adaptive_steps ? 1u : 0u);
+}
+
+bool ReconIntegration::isAdaptiveSteps() const {
+  return m_adaptive_steps;
+}
+
+void ReconIntegration::setStepImage(bool enable) {
+  m_write_steps = enable;
+  m_program->setUniform("write_steps", m_write_steps ? 1u : 0u);
+}
+
+bool ReconIntegration::isStepImage() const {
+  return m_write_steps;
+}
+
+glm::fvec2 ReconIntegration::readStepCounts() const {
+  glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+  std::vector<unsigned char> data{m_image_steps->getImage(0, GL_RED_INTEGER, GL_UNSIGNED_INT)};
+  unsigned const* counts = reinterpret_cast<unsigned const*>(data.data());
+  std::size_t num_pixels = data.size() / sizeof(unsigned);
+  // pixels without a ray stay zero
+  std::size_t num_rays = 0;
+  double sum_steps = 0.0;
+  unsigned max_steps = 0;
+  for (std::size_t i = 0; i < num_pixels; ++i) {
+    if (counts[i] > 0) {
+      ++num_rays;
+      sum_steps += counts[i];
+      max_steps = std::max(max_steps, counts[i]);
+    }
+  }
+  return glm::fvec2{num_rays > 0 ? float(sum_steps / num_rays) : 0.0f, float(max_steps)};
+}
+
+void ReconIntegration::setPrecomputedShading(bool enable) {
+  // the raymarcher has no atlas lookup for the companion volumes
+  m_precomputed_shading = enable && !m_sparse;
+  if (m_precomputed_shading && !m_volume_color) {
+    createShadingVolumes();
+  }
+  m_program->setUniform("precomputed_shading", m_precomputed_shading ? 1u : 0u);
+  m_program_integration->setUniform("write_shading", m_precomputed_shading ? 1u : 0u);
+  m_program_compute->setUniform("write_shading", m_precomputed_shading ? 1u : 0u);
+}
+
+bool ReconIntegration::isPrecomputedShading() const {
+  return m_precomputed_shading;
+}
+
+Mesh ReconIntegration::extractMesh() {
+  if (m_sparse) {
+    throw std::logic_error{"mesh extraction needs a dense volume"};
+  }
+  // colors only exist when integrating with shading volumes
+  bool precomputed_shading = m_precomputed_shading;
+  if (!precomputed_shading) {
+    setPrecomputedShading(true);
+    // the tsdf already holds the frame, fusing it again would count it twice
+    m_program_integration->setUniform("write_tsdf", 0u);
+    m_program_compute->setUniform("write_tsdf", 0u);
+    integrate();
+    m_program_integration->setUniform("write_tsdf", 1u);
+    m_program_compute->setUniform("write_tsdf", 1u);
+  }
+  glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+  std::size_t num_voxels = std::size_t(m_res_volume.x) * m_res_volume.y * m_res_volume.z;
+  std::vector<float> tsdf(num_voxels);
+  m_volume_tsdf->getImage(0, GL_RED, GL_FLOAT, tsdf.data());
+  std::vector<glm::u8vec4> colors(num_voxels);
+  m_volume_color->getImage(0, GL_RGBA, GL_UNSIGNED_BYTE, colors.data());
+  setPrecomputedShading(precomputed_shading);
+
+  sensor::Timer timer{};
+  timer.start();
+  Mesh mesh{kinect::extractMesh(tsdf, m_res_volume, m_mat_vol_to_world, colors)};
+  timer.stop();
+  std::cout << "extracted " << mesh.positions.size() << " vertices and " << mesh.indices.size() / 3
+            << " triangles in " << timer.get().msec() << " ms" << std::endl;
+  return mesh;
+}
+
+void ReconIntegration::computeSensorDistanceBoxes(std::vector<glm::fvec3>& boxes_min, std::vector<glm::fvec3>& boxes_max) const {
+  std::vector<glm::fvec3> sensors{};
+  for(unsigned i = 0; i < m_num_kinects; ++i) {
+    sensors.push_back(m_cv->getFrustum(i).getCameraPos());
+  }
+  // distance of every base voxel to its nearest sensor
+  std::vector<float> distances(std::size_t(m_res_volume.x) * m_res_volume.y * m_res_volume.z);
+  #pragma omp parallel for
+  for (int z = 0; z < int(m_res_volume.z); ++z) {
+    for (unsigned y = 0; y < m_res_volume.y; ++y) {
+      for (unsigned x = 0; x < m_res_volume.x; ++x) {
+        glm::fvec3 pos_vol{(glm::fvec3{float(x), float(y), float(z)} + 0.5f) / glm::fvec3{m_res_volume}};
+        glm::fvec3 pos_world{m_mat_vol_to_world * glm::fvec4{pos_vol, 1.0f}};
+        float distance = std::numeric_limits<float>::max();
+        for (auto const& sensor : sensors) {
+          distance = std::min(distance, glm::length(pos_world - sensor));
+        }
+        distances[(std::size_t(z) * m_res_volume.y + y) * m_res_volume.x + x] = distance;
+      }
+    }
+  }
+  float max_distance = *std::max_element(distances.begin(), distances.end());
+  // level l covers the voxels further than l / levels of the maximal distance
+  for (unsigned l = 1; l < m_levels; ++l) {
+    float threshold = max_distance * float(l) / float(m_levels);
+    glm::uvec3 voxel_min{m_res_volume};
+    glm::uvec3 voxel_max{0};
+    for (unsigned z = 0; z < m_res_volume.z; ++z) {
+      for (unsigned y = 0; y < m_res_volume.y; ++y) {
+        for (unsigned x = 0; x < m_res_volume.x; ++x) {
+          if (distances[(std::size_t(z) * m_res_volume.y + y) * m_res_volume.x + x] >= threshold) {
+            voxel_min = glm::min(voxel_min, glm::uvec3{x, y, z});
+            voxel_max = glm::max(voxel_max, glm::uvec3{x, y, z} + 1u);
+          }
+        }
+      }
+    }
+    boxes_min.push_back(glm::fvec3{voxel_min} / glm::fvec3{m_res_volume});
+    boxes_max.push_back(glm::fvec3{voxel_max} / glm::fvec3{m_res_volume});
+  }
+}
+
+void ReconIntegration::createNestedLevels(std::vector<glm::fvec3> const& boxes_min, std::vector<glm::fvec3> const& boxes_max) {
+  for (auto const& level : m_nested) {
+    level.volume_tsdf->destroy();
+    level.volume_weight->destroy();
+    level.buffer_bricks->destroy();
+  }
+  m_nested.clear();
+
+  std::vector<Frustum> frustums{};
+  for(unsigned i = 0; i < m_num_kinects; ++i) {
+    frustums.push_back(m_cv->getFrustum(i));
+  }
+  glm::fvec3 bbox_dimensions = glm::fvec3{m_bbox.getPMax()[0] - m_bbox.getPMin()[0],
+                                          m_bbox.getPMax()[1] - m_bbox.getPMin()[1],
+                                          m_bbox.getPMax()[2] - m_bbox.getPMin()[2]};
+  float mb_nested = 0.0f;
+  std::vector<int> units{};
+  std::vector<glm::fvec3> nested_min{};
+  std::vector<glm::fvec3> nested_size{};
+  std::vector<glm::uvec3> nested_res{};
+  for (unsigned l = 1; l < m_levels; ++l) {
+    float scale = float(1u << (m_levels - 1 - l));
+    NestedLevel level{};
+    level.limit = limit * scale;
+    // whole voxels of the level, the box grows to fit them
+    glm::fvec3 box_metric{(boxes_max[l - 1] - boxes_min[l - 1]) * bbox_dimensions};
+    level.res = glm::uvec3{glm::max(glm::ceil(box_metric / (voxel_size * scale)), glm::fvec3{1.0f})};
+    level.box_size = glm::min(glm::fvec3{level.res} * voxel_size * scale / bbox_dimensions, glm::fvec3{1.0f});
+    level.box_min = glm::clamp(boxes_min[l - 1], glm::fvec3{0.0f}, glm::fvec3{1.0f} - level.box_size);
+
+    std::vector<float> empty_tsdf(std::size_t(level.res.x) * level.res.y * level.res.z, level.limit);
+    level.volume_tsdf = globjects::Texture::createDefault(GL_TEXTURE_3D);
+    level.volume_tsdf->image3D(0, GL_R32F, glm::ivec3{level.res}, 0, GL_RED, GL_FLOAT, empty_tsdf.data());
+    level.volume_weight = globjects::Texture::createDefault(GL_TEXTURE_3D);
+    std::vector<float> empty_weight(empty_tsdf.size(), 0.0f);
+    level.volume_weight->image3D(0, GL_R32F, glm::ivec3{level.res}, 0, GL_RED, GL_FLOAT, empty_weight.data());
+
+    glm::fvec3 world_min{m_mat_vol_to_world * glm::fvec4{level.box_min, 1.0f}};
+    glm::fvec3 world_max{m_mat_vol_to_world * glm::fvec4{level.box_min + level.box_size, 1.0f}};
+    gloost::BoundingBox box{gloost::Point3{world_min.x, world_min.y, world_min.z}, gloost::Point3{world_max.x, world_max.y, world_max.z}};
+    std::vector<unsigned> bricks{computeVisibleBricks(computeValidityVolume(frustums, box, level.res), brick_size)};
+    level.num_bricks = bricks.size();
+    level.buffer_bricks = new globjects::Buffer();
+    level.buffer_bricks->setData(bricks, GL_STATIC_DRAW);
+
+    std::cout << "level " << l << " with " << voxel_size * scale << " m voxels, resolution "
+              << level.res.x << ", " << level.res.y << ", " << level.res.z << ", " << bricks.size() << " bricks visible" << std::endl;
+    mb_nested += float(empty_tsdf.size()) * sizeof(float) / 1024.0f / 1024.0f;
+    units.push_back(nested_texture_unit + l - 1);
+    nested_min.push_back(level.box_min);
+    nested_size.push_back(level.box_size);
+    nested_res.push_back(level.res);
+    m_nested.push_back(level);
+  }
+  float mb_base = float(m_res_volume.x) * m_res_volume.y * m_res_volume.z * sizeof(float) / 1024.0f / 1024.0f;
+  glm::fvec3 res_finest{glm::ceil(bbox_dimensions / voxel_size)};
+  float mb_dense = res_finest.x * res_finest.y * res_finest.z * sizeof(float) / 1024.0f / 1024.0f;
+  std::cout << m_levels << " tsdf levels, " << mb_base + mb_nested << " MB instead of " << mb_dense << " MB dense" << std::endl;
+
+  m_program->setUniform("num_nested", unsigned(m_nested.size()));
+  m_program->setUniform("volume_nested", units);
+  m_program->setUniform("nested_min", nested_min);
+  m_program->setUniform("nested_size", nested_size);
+  m_program->setUniform("nested_res", nested_res);
+}
+
+void ReconIntegration::integrateNested() {
+  m_timer_stages.start("integrate nested");
+  m_program_compute->use();
+  // shading volumes only exist for the base level
+  m_program_compute->setUniform("write_shading", 0u);
+  m_program_compute->setUniform("sparse", 0u);
+  glm::uvec3 res_inv{m_cv->getVolumeRes()};
+  for (auto const& level : m_nested) {
+    level.volume_tsdf->bindImageTexture(start_image_unit, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+    level.volume_weight->bindImageTexture(weight_image_unit, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32F);
+    level.buffer_bricks->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_bricks);
+    bool cache_inv = glm::all(glm::lessThanEqual(glm::fvec3{res_inv} * level.box_size, glm::fvec3{level.res}));
+    m_program_compute->setUniform("cache_inv", cache_inv ? 1u : 0u);
+    m_program_compute->setUniform("res_tsdf", level.res);
+    m_program_compute->setUniform("level_min", level.box_min);
+    m_program_compute->setUniform("level_size", level.box_size);
+    m_program_compute->setUniform("limit", level.limit);
+    m_program_compute->setUniform("num_bricks", level.num_bricks);
+    unsigned groups_x = std::min(level.num_bricks, 65535u);
+    unsigned groups_y = (level.num_bricks + groups_x - 1) / groups_x;
+    if (level.num_bricks > 0) {
+      m_program_compute->dispatchCompute(groups_x, groups_y, 1);
+    }
+  }
+  m_program_compute->release();
+  // back to the base level
+  bool cache_inv = glm::all(glm::lessThanEqual(res_inv, m_res_volume));
+  m_program_compute->setUniform("cache_inv", cache_inv ? 1u : 0u);
+  m_program_compute->setUniform("res_tsdf", m_res_volume);
+  m_program_compute->setUniform("level_min", glm::fvec3{0.0f});
+  m_program_compute->setUniform("level_size", glm::fvec3{1.0f});
+  m_program_compute->setUniform("limit", m_limit_base);
+  m_program_compute->setUniform("num_bricks", m_num_bricks);
+  m_program_compute->setUniform("write_shading", m_precomputed_shading ? 1u : 0u);
+  m_program_compute->setUniform("sparse", m_sparse ? 1u : 0u);
+  m_timer_stages.stop("integrate nested");
+}
+
+void ReconIntegration::setRegionOfInterest(gloost::BoundingBox const& roi) {
+  if (m_levels < 2) {
+    return;
+  }
+  glm::fmat4 world_to_vol{glm::inverse(m_mat_vol_to_world)};
+  glm::fvec3 roi_min{world_to_vol * glm::fvec4{roi.getPMin()[0], roi.getPMin()[1], roi.getPMin()[2], 1.0f}};
+  glm::fvec3 roi_max{world_to_vol * glm::fvec4{roi.getPMax()[0], roi.getPMax()[1], roi.getPMax()[2], 1.0f}};
+  roi_min = glm::clamp(roi_min, glm::fvec3{0.0f}, glm::fvec3{1.0f});
+  roi_max = glm::clamp(roi_max, roi_min, glm::fvec3{1.0f});
+  std::vector<glm::fvec3> boxes_min{};
+  std::vector<glm::fvec3> boxes_max{};
+  for (unsigned l = 1; l < m_levels; ++l) {
+    float t = float(m_levels - 1 - l) / float(m_levels - 1);
+    boxes_min.push_back(glm::mix(roi_min, glm::fvec3{0.0f}, t));
+    boxes_max.push_back(glm::mix(roi_max, glm::fvec3{1.0f}, t));
+  }
+  createNestedLevels(boxes_min, boxes_max);
+}
+
+unsigned ReconIntegration::getLevels() const {
+  return m_levels;
+}
+
+}
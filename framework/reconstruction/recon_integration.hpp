@@ -3,29 +3,144 @@
 
 #include "reconstruction.hpp"
 #include "volume_sampler.hpp"
+#include "marching_cubes.hpp"
 
 #include <globjects/Buffer.h>
 #include <globjects/Program.h>
 #include <globjects/VertexArray.h>
 #include <globjects/Texture.h>
 
+#include <array>
+#include <vector>
+
 namespace kinect{
 
   class ReconIntegration : public Reconstruction {
 
   public:
-    ReconIntegration(CalibrationFiles const& cfs, CalibVolumes const* cv, gloost::BoundingBox const&  bbox);
+    // sparse volumes only allocate bricks near observed surfaces
+    // dense volumes with more than one level halve the voxel size per nested level, the finest has the default size
+    ReconIntegration(CalibrationFiles const& cfs, CalibVolumes const* cv, gloost::BoundingBox const&  bbox, bool sparse = false, unsigned levels = 1);
     ~ReconIntegration();
 
     void draw() override;
+    void resize(std::size_t width, std::size_t height) override;
     void integrate();
 
+    // compute shader over visible bricks, vertex shader over all voxels otherwise
+    // sparse volumes always use the compute shader
+    void setComputeIntegration(bool enable);
+    bool isComputeIntegration() const;
+
+    // running weighted average over frames instead of per frame recomputation
+    void setTemporalFusion(bool enable);
+    bool isTemporalFusion() const;
+    // caps the history so the average keeps adapting
+    void setMaxWeight(float weight);
+    // tsd change treated as motion and factor applied to the history weight then
+    void setMotionDecay(float threshold, float decay);
+
+    // skip bricks without zero crossing using a min max pyramid, dense volumes only
+    void setEmptySkipping(bool enable);
+    bool isEmptySkipping() const;
+    // count raymarching samples, costs two atomics per fragment
+    void setRaymarchStats(bool enable);
+    // average over the rays of the previous frame
+    float getSamplesPerRay() const;
+
+    // step by the truncated distance outside the band and bisect crossings
+    void setAdaptiveSteps(bool enable);
+    bool isAdaptiveSteps() const;
+    // write the samples of each pixel to an image
+    void setStepImage(bool enable);
+    bool isStepImage() const;
+    // mean and max samples of the pixels in the step image, stalls until the frame is done
+    glm::fvec2 readStepCounts() const;
+
+    // blend color and normal during integration into companion volumes, dense volumes only
+    void setPrecomputedShading(bool enable);
+    bool isPrecomputedShading() const;
+
+    // triangle mesh of the current tsdf with blended vertex colors, dense volumes only
+    // only the base level is meshed
+    Mesh extractMesh();
+
+    // box in world space covered by the finest level, intermediate levels interpolate towards the bbox
+    // by default levels get finer with the distance to the nearest sensor
+    void setRegionOfInterest(gloost::BoundingBox const& roi);
+    unsigned getLevels() const;
+
   private:
+    void createBricks();
+    void createSparseVolume();
+    void resetPool();
+    void allocateBricks();
+    void evictBricks();
+    void createMinMaxPyramid();
+    void updateMinMaxPyramid();
+    void bindTextures() const;
+    void updateRaymarchStats();
+    void createShadingVolumes();
+    void updateFusionUniforms();
+    void createNestedLevels(std::vector<glm::fvec3> const& boxes_min, std::vector<glm::fvec3> const& boxes_max);
+    void computeSensorDistanceBoxes(std::vector<glm::fvec3>& boxes_min, std::vector<glm::fvec3>& boxes_max) const;
+    void integrateNested();
+
+    // volume of a finer level inside the base volume, box in base volume space
+    struct NestedLevel {
+      globjects::Texture* volume_tsdf;
+      globjects::Texture* volume_weight;
+      globjects::Buffer*  buffer_bricks;
+      unsigned            num_bricks;
+      glm::uvec3          res;
+      glm::fvec3          box_min;
+      glm::fvec3          box_size;
+      float               limit;
+    };
+
     globjects::Program* m_program;
     globjects::Program* m_program_integration;
+    globjects::Program* m_program_compute;
+    globjects::Buffer*  m_buffer_bricks;
+    unsigned            m_num_bricks;
+    bool                m_use_compute;
+    bool                m_sparse;
+    globjects::Program* m_program_alloc;
+    globjects::Buffer*  m_buffer_candidates;
+    globjects::Buffer*  m_buffer_hash;
+    globjects::Buffer*  m_buffer_allocation;
+    unsigned            m_num_candidates;
+    unsigned            m_pool_res;
+    globjects::Program* m_program_evict;
+    globjects::Buffer*  m_buffer_ages;
+    globjects::Buffer*  m_buffer_free;
+    unsigned            m_frame_alloc;
+    globjects::Program* m_program_minmax;
+    globjects::Texture* m_volume_minmax;
+    glm::uvec3          m_res_minmax;
+    unsigned            m_levels_minmax;
+    bool                m_skip_empty;
+    bool                m_collect_stats;
+    std::array<globjects::Buffer*, 2> m_buffers_stats;
+    unsigned            m_frame;
+    float               m_samples_per_ray;
+    bool                m_adaptive_steps;
+    bool                m_write_steps;
+    globjects::Texture* m_image_steps;
+    bool                m_precomputed_shading;
+    globjects::Texture* m_volume_color;
+    globjects::Texture* m_volume_normal;
+    unsigned            m_levels;
+    float               m_limit_base;
+    std::vector<NestedLevel> m_nested;
     glm::uvec3          m_res_volume;
     VolumeSampler       m_sampler;
     globjects::Texture* m_volume_tsdf;
+    globjects::Texture* m_volume_weight;
+    bool                m_temporal;
+    float               m_max_weight;
+    float               m_motion_threshold;
+    float               m_motion_decay;
 
     glm::fmat4          m_mat_vol_to_world;
   };
@@ -6,11 +6,20 @@
 
 #include <Matrix.h>
 #include <glm/gtc/type_precision.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <globjects/VertexAttributeBinding.h>
 #include <globjects/Shader.h>
 
+#include <algorithm>
+
 namespace kinect{
 
+static unsigned tile_size = 16;
+static unsigned storage_binding_commands = 10;
+static unsigned storage_binding_stats = 11;
+// as gl_PointSize of points.gs
+static float point_size = 10.0f;
+
 void
 static getWidthHeight(unsigned& width, unsigned& height){
   GLsizei vp_params[4];
@@ -23,7 +32,14 @@ ReconPoints::ReconPoints(CalibrationFiles const& cfs, CalibVolumes const* cv, gl
  :Reconstruction(cfs, cv, bbox)
  ,m_point_grid{new globjects::VertexArray()}
  ,m_point_buffer{new globjects::Buffer()}
+ ,m_buffer_commands{new globjects::Buffer()}
+ ,m_num_tiles{(m_tex_width + tile_size - 1) / tile_size, (m_tex_height + tile_size - 1) / tile_size}
+ ,m_lod{true}
+ ,m_buffers_stats{{new globjects::Buffer(), new globjects::Buffer()}}
+ ,m_frame{0}
+ ,m_num_points{0}
  ,m_program{new globjects::Program()}
+ ,m_program_lod{new globjects::Program()}
 {
   m_program->attach(
     globjects::Shader::fromFile(GL_VERTEX_SHADER,   "glsl/points.vs"),
@@ -39,17 +55,57 @@ ReconPoints::ReconPoints(CalibrationFiles const& cfs, CalibVolumes const* cv, gl
   m_program->setUniform("epsilon" , 0.075f);
   m_program->setUniform("cv_xyz", m_cv->getXYZVolumeUnits());
   m_program->setUniform("cv_uv", m_cv->getUVVolumeUnits());
+  m_cv->setDecodeUniforms(m_program);
 
+  m_program_lod->attach(
+    globjects::Shader::fromFile(GL_COMPUTE_SHADER, "glsl/points_lod.cs")
+  );
+  m_program_lod->setUniform("kinect_depths", 2);
+  m_program_lod->setUniform("res_depth", glm::uvec2{m_tex_width, m_tex_height});
+  m_program_lod->setUniform("num_tiles", m_num_tiles);
+  m_program_lod->setUniform("tile_size", tile_size);
+  m_program_lod->setUniform("max_stride", tile_size);
+  m_program_lod->setUniform("point_size", point_size);
+  m_program_lod->setUniform("cv_xyz", m_cv->getXYZVolumeUnits());
+  m_cv->setDecodeUniforms(m_program_lod);
+
+  // points are grouped by tile, inside a tile the coarsest strides come first
+  // so the points of each stride are a prefix of the tile
   std::vector<glm::fvec2> data{};
+  std::vector<unsigned> tile_firsts{};
   float stepX = 1.0f / m_tex_width;
   float stepY = 1.0f / m_tex_height;
-  for(unsigned y = 0; y < m_tex_height; ++y) {
-    for(unsigned x = 0; x < m_tex_width; ++x) {
-      data.emplace_back((x+0.5) * stepX, (y + 0.5) * stepY);
+  for(unsigned ty = 0; ty < m_num_tiles.y; ++ty) {
+    for(unsigned tx = 0; tx < m_num_tiles.x; ++tx) {
+      tile_firsts.push_back(unsigned(data.size()));
+      for(unsigned stride = tile_size; stride > 0; stride /= 2) {
+        for(unsigned y = ty * tile_size; y < std::min((ty + 1) * tile_size, m_tex_height); ++y) {
+          for(unsigned x = tx * tile_size; x < std::min((tx + 1) * tile_size, m_tex_width); ++x) {
+            // coarser strides are already contained
+            bool in_stride = x % stride == 0 && y % stride == 0;
+            bool in_coarser = stride < tile_size && x % (stride * 2) == 0 && y % (stride * 2) == 0;
+            if (in_stride && !in_coarser) {
+              data.emplace_back((x+0.5) * stepX, (y + 0.5) * stepY);
+            }
+          }
+        }
+      }
     }
   }
   m_point_buffer->setData(data, GL_STATIC_DRAW);
 
+  // counts are written by the lod selection
+  std::vector<unsigned> commands{};
+  for(unsigned i = 0; i < m_num_kinects; ++i) {
+    for(unsigned first : tile_firsts) {
+      commands.insert(commands.end(), {0u, 1u, first, i});
+    }
+  }
+  m_buffer_commands->setData(commands, GL_DYNAMIC_COPY);
+  for(auto& buffer : m_buffers_stats) {
+    buffer->setData(sizeof(unsigned), nullptr, GL_DYNAMIC_READ);
+  }
+
   m_point_grid->enable(0);
   m_point_grid->binding(0)->setAttribute(0);
   m_point_grid->binding(0)->setBuffer(m_point_buffer, 0, sizeof(glm::fvec2));
@@ -61,11 +117,48 @@ ReconPoints::ReconPoints(CalibrationFiles const& cfs, CalibVolumes const* cv, gl
 ReconPoints::~ReconPoints() {
   m_point_grid->destroy();
   m_point_buffer->destroy();
+  m_buffer_commands->destroy();
+  for(auto& buffer : m_buffers_stats) {
+    buffer->destroy();
+  }
   m_program->destroy();
+  m_program_lod->destroy();
+}
+
+void ReconPoints::selectLod() {
+  // previous frame is likely finished, avoids waiting for the current one
+  auto& buffer_prev = m_buffers_stats[(m_frame + 1) % 2];
+  m_num_points = buffer_prev->getSubData<unsigned, 1>()[0];
+  auto& buffer_curr = m_buffers_stats[m_frame % 2];
+  unsigned empty = 0;
+  buffer_curr->setSubData(0, sizeof(empty), &empty);
+  ++m_frame;
+
+  glm::fmat4 modelview{};
+  glm::fmat4 projection{};
+  glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(modelview));
+  glGetFloatv(GL_PROJECTION_MATRIX, glm::value_ptr(projection));
+  unsigned width  = 0;
+  unsigned height = 0;
+  getWidthHeight(width, height);
+
+  m_timer_stages.start("lod");
+  m_buffer_commands->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_commands);
+  buffer_curr->bindBase(GL_SHADER_STORAGE_BUFFER, storage_binding_stats);
+  m_program_lod->setUniform("modelview", modelview);
+  m_program_lod->setUniform("projection", projection);
+  m_program_lod->setUniform("res_target", glm::fvec2(width, height));
+  m_program_lod->use();
+  m_program_lod->dispatchCompute((m_num_tiles.x + 7) / 8, (m_num_tiles.y + 7) / 8, m_num_kinects);
+  m_program_lod->release();
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+  m_timer_stages.stop("lod");
 }
 
 void
 ReconPoints::draw(){
+  selectLod();
+
   // calculate img_to_eye for this view
   gloost::Matrix projection_matrix;
   glGetFloatv(GL_PROJECTION_MATRIX, projection_matrix.data());
@@ -96,14 +189,27 @@ ReconPoints::draw(){
   modelview_inv.invert();
 
   m_program->setUniform("modelview_inv", modelview_inv);
+  m_timer_stages.start("points");
   m_program->use();
 
-  for(unsigned layer = 0; layer < m_num_kinects; ++layer) {
-    m_program->setUniform("layer",  layer);
-
-    m_point_grid->drawArrays(GL_POINTS, 0, m_tex_width * m_tex_height);
-  }
+  m_buffer_commands->bind(GL_DRAW_INDIRECT_BUFFER);
+  m_point_grid->multiDrawArraysIndirect(GL_POINTS, nullptr, m_num_tiles.x * m_num_tiles.y * m_num_kinects, 0);
   m_program->release();
+  m_timer_stages.stop("points");
+}
+
+void ReconPoints::setLod(bool enable) {
+  m_lod = enable;
+  // stride 1 draws every point
+  m_program_lod->setUniform("max_stride", m_lod ? tile_size : 1u);
+}
+
+bool ReconPoints::isLod() const {
+  return m_lod;
+}
+
+unsigned ReconPoints::getNumPoints() const {
+  return m_num_points;
 }
 
 }
\ No newline at end of file
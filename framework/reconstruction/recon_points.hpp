@@ -6,6 +6,9 @@
 #include <globjects/Buffer.h>
 #include <globjects/Program.h>
 #include <globjects/VertexArray.h>
+#include <glm/gtc/type_precision.hpp>
+
+#include <array>
 
 namespace kinect{
 
@@ -17,11 +20,28 @@ namespace kinect{
 
     void draw() override;
 
+    // subsample tiles of the depth grid by their point density on screen
+    void setLod(bool enable);
+    bool isLod() const;
+    // drawn points of the previous frame
+    unsigned getNumPoints() const;
+
   private:
+    // chooses the point count of each tile
+    void selectLod();
+
     globjects::VertexArray*              m_point_grid;
     globjects::Buffer*                  m_point_buffer;
+    // one indirect draw per tile and camera, camera index is the base instance
+    globjects::Buffer*                  m_buffer_commands;
+    glm::uvec2                           m_num_tiles;
+    bool                                 m_lod;
+    std::array<globjects::Buffer*, 2>    m_buffers_stats;
+    unsigned                             m_frame;
+    unsigned                             m_num_points;
 
     globjects::Program*                  m_program;
+    globjects::Program*                  m_program_lod;
   };
 }
 
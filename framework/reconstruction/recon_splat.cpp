@@ -0,0 +1,98 @@
+#include "recon_splat.hpp"
+
+#include "calibration_files.hpp"
+#include "screen_quad.hpp"
+#include <KinectCalibrationFile.h>
+#include "CalibVolumes.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <globjects/Shader.h>
+
+#include <cstdint>
+
+namespace kinect{
+
+ReconSplat::ReconSplat(CalibrationFiles const& cfs, CalibVolumes const* cv, gloost::BoundingBox const&  bbox)
+ :Reconstruction(cfs, cv, bbox)
+ ,m_buffer_visibility{new globjects::Buffer()}
+ ,m_res_visibility{0}
+ ,m_program_splat{new globjects::Program()}
+ ,m_program_resolve{new globjects::Program()}
+{
+  m_program_splat->attach(
+    globjects::Shader::fromFile(GL_COMPUTE_SHADER, "glsl/splat_points.cs")
+  );
+  m_program_splat->setUniform("kinect_colors", 1);
+  m_program_splat->setUniform("kinect_depths", 2);
+  m_program_splat->setUniform("bbox_min", m_bbox.getPMin());
+  m_program_splat->setUniform("bbox_max", m_bbox.getPMax());
+  m_program_splat->setUniform("res_depth", glm::uvec2{m_tex_width, m_tex_height});
+  // same size as the points of ReconPoints
+  m_program_splat->setUniform("point_size", 10.0f);
+  m_program_splat->setUniform("max_point_size", 64.0f);
+  m_program_splat->setUniform("cv_xyz", m_cv->getXYZVolumeUnits());
+  m_program_splat->setUniform("cv_uv", m_cv->getUVVolumeUnits());
+  m_cv->setDecodeUniforms(m_program_splat);
+
+  m_program_resolve->attach(
+    globjects::Shader::fromFile(GL_VERTEX_SHADER,   "glsl/texture_passthrough.vs"),
+    globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "glsl/splat_resolve.fs")
+  );
+
+  reload();
+
+  resize(600, 480);
+}
+
+ReconSplat::~ReconSplat() {
+  m_buffer_visibility->destroy();
+  m_program_splat->destroy();
+  m_program_resolve->destroy();
+}
+
+void ReconSplat::draw(){
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glm::uvec2 res_target{viewport[2], viewport[3]};
+  if (res_target.x * res_target.y > m_res_visibility.x * m_res_visibility.y) {
+    resize(res_target.x, res_target.y);
+  }
+  glm::fmat4 modelview{};
+  glm::fmat4 projection{};
+  glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(modelview));
+  glGetFloatv(GL_PROJECTION_MATRIX, glm::value_ptr(projection));
+
+  m_timer_stages.start("splat");
+  // farthest depth and no color
+  std::uint32_t const empty[2] = {0xFFFFFFFFu, 0xFFFFFFFFu};
+  m_buffer_visibility->clearData(GL_RG32UI, GL_RG_INTEGER, GL_UNSIGNED_INT, empty);
+  m_buffer_visibility->bindBase(GL_SHADER_STORAGE_BUFFER, 9);
+
+  m_program_splat->setUniform("res_target", res_target);
+  m_program_splat->setUniform("modelview", modelview);
+  m_program_splat->setUniform("projection", projection);
+  m_program_splat->use();
+  m_program_splat->dispatchCompute((m_tex_width + 7) / 8, (m_tex_height + 7) / 8, m_num_kinects);
+  m_program_splat->release();
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  m_timer_stages.stop("splat");
+
+// resolve writes the closest splat of each pixel to the framebuffer of parent renderstage
+  m_timer_stages.start("resolve");
+  glEnable(GL_DEPTH_TEST);
+  m_program_resolve->use();
+  m_program_resolve->setUniform("res_target", res_target);
+  m_program_resolve->setUniform("offset", glm::fvec2(1.0f * viewport[0], 1.0f * viewport[1]));
+
+  ScreenQuad::draw();
+
+  m_program_resolve->release();
+  m_timer_stages.stop("resolve");
+}
+
+void ReconSplat::resize(std::size_t width, std::size_t height) {
+  m_res_visibility = glm::uvec2{width, height};
+  m_buffer_visibility->setData(width * height * sizeof(std::uint64_t), nullptr, GL_DYNAMIC_COPY);
+}
+
+}
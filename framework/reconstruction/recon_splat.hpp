@@ -0,0 +1,33 @@
+#ifndef RECON_SPLAT_HPP
+#define RECON_SPLAT_HPP
+
+#include "reconstruction.hpp"
+
+#include <globjects/Buffer.h>
+#include <globjects/Program.h>
+#include <glm/gtc/type_precision.hpp>
+
+namespace kinect{
+
+  // points of ReconPoints splatted in a compute shader with 64 bit atomics
+  class ReconSplat : public Reconstruction {
+
+  public:
+    ReconSplat(CalibrationFiles const& cfs, CalibVolumes const* cv, gloost::BoundingBox const&  bbox);
+    ~ReconSplat();
+
+    void draw() override;
+
+    void resize(std::size_t width, std::size_t height) override;
+
+  private:
+    // closest depth and color per pixel of the viewport
+    globjects::Buffer*                   m_buffer_visibility;
+    glm::uvec2                           m_res_visibility;
+
+    globjects::Program*                  m_program_splat;
+    globjects::Program*                  m_program_resolve;
+  };
+}
+
+#endif // #ifndef RECON_SPLAT_HPP
@@ -2,49 +2,69 @@
 
 #include "calibration_files.hpp"
 #include "screen_quad.hpp"
+#include "RenderTargetPool.h"
 #include <KinectCalibrationFile.h>
 #include "CalibVolumes.hpp"
 
-#include <Matrix.h>
 #include <glm/gtc/type_precision.hpp>
-#include <globjects/VertexAttributeBinding.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <globjects/Shader.h>
+#include <globjects/globjects.h>
 
-namespace kinect{
+#include <iostream>
+#include <stdexcept>
 
-void
-static getWidthHeight(unsigned& width, unsigned& height){
-  GLsizei vp_params[4];
-  glGetIntegerv(GL_VIEWPORT,vp_params);
-  width  = vp_params[2];
-  height = vp_params[3];
-}
+namespace kinect{
 
 ReconTrigrid::ReconTrigrid(CalibrationFiles const& cfs, CalibVolumes const* cv, gloost::BoundingBox const&  bbox)
  :Reconstruction(cfs, cv, bbox)
- ,m_va_pass_depth()
- ,m_va_pass_accum()
+ ,m_num_views{1}
+ ,m_layered{globjects::hasExtension(GLextension::GL_ARB_shader_viewport_layer_array)}
  ,m_tri_grid{new globjects::VertexArray()}
- ,m_tri_buffer{new globjects::Buffer()}
+ ,m_buffer_indices{new globjects::Buffer()}
+ ,m_buffer_commands{new globjects::Buffer()}
+ ,m_buffer_vertices{new globjects::Buffer()}
+ ,m_commands_empty{}
+ ,m_culler{}
+ ,m_cull_backfaces{true}
+ ,m_program_compact{new globjects::Program()}
  ,m_program_accum{new globjects::Program()}
  ,m_program_normalize{new globjects::Program()}
 {
   m_program_accum->attach(
     globjects::Shader::fromFile(GL_VERTEX_SHADER,   "glsl/trigrid_accum.vs"),
-    globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "glsl/trigrid_accum.fs"),
-    globjects::Shader::fromFile(GL_GEOMETRY_SHADER, "glsl/trigrid_accum.gs")
+    globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "glsl/trigrid_accum.fs")
   );
 
   m_program_accum->setUniform("kinect_colors",1);
-  m_program_accum->setUniform("kinect_depths",2);
-  m_program_accum->setUniform("kinect_qualities",3);
   m_program_accum->setUniform("depth_map_curr",14);
   m_program_accum->setUniform("bbox_min",m_bbox.getPMin());
   m_program_accum->setUniform("bbox_max",m_bbox.getPMax());
   m_program_accum->setUniform("epsilon"    , 0.075f);
-  m_program_accum->setUniform("min_length", m_min_length);
-  m_program_accum->setUniform("cv_xyz", m_cv->getXYZVolumeUnits());
-  m_program_accum->setUniform("cv_uv", m_cv->getUVVolumeUnits());
+  m_program_accum->setUniform("res_depth", glm::uvec2{m_tex_width, m_tex_height});
+  m_program_accum->setUniform("view_offset", 0u);
+  if (!m_layered) {
+    std::cout << "trigrid - no GL_ARB_shader_viewport_layer_array, drawing views one by one" << std::endl;
+  }
+
+  m_program_compact->attach(
+    globjects::Shader::fromFile(GL_COMPUTE_SHADER, "glsl/trigrid_compact.cs")
+  );
+  m_program_compact->setUniform("kinect_depths",2);
+  m_program_compact->setUniform("kinect_qualities",3);
+  m_program_compact->setUniform("min_length", m_min_length);
+  m_program_compact->setUniform("res_depth", glm::uvec2{m_tex_width, m_tex_height});
+  m_program_compact->setUniform("cv_xyz", m_cv->getXYZVolumeUnits());
+  m_program_compact->setUniform("cv_uv", m_cv->getUVVolumeUnits());
+  m_cv->setDecodeUniforms(m_program_compact);
+  std::vector<glm::fvec3> sensor_positions{};
+  for (unsigned i = 0; i < m_num_kinects; ++i) {
+    sensor_positions.push_back(m_cv->getFrustum(i).getCameraPos());
+  }
+  m_program_compact->setUniform("sensor_pos", sensor_positions);
+  m_program_compact->setUniform("cull_backfaces", unsigned(m_cull_backfaces));
 
   m_program_normalize->attach(
      globjects::Shader::fromFile(GL_VERTEX_SHADER,   "glsl/trigrid_normalize.vs")
@@ -53,117 +73,195 @@ ReconTrigrid::ReconTrigrid(CalibrationFiles const& cfs, CalibVolumes const* cv,
   m_program_normalize->setUniform("color_map",15);
   m_program_normalize->setUniform("depth_map",16);
 
-  std::vector<glm::fvec2> data{};
-  float stepX = 1.0f/m_tex_width;
-  float stepY = 1.0f/m_tex_height;
-  for(unsigned y = 0; y < m_tex_width; ++y){
-    for(unsigned x = 0; x < m_tex_height; ++x){
-      data.emplace_back( (x+0.5) * stepX, (y + 0.5) * stepY );
-      data.emplace_back( (x+1.5) * stepX, (y + 0.5) * stepY );
-      data.emplace_back( (x+0.5) * stepX, (y + 1.5) * stepY );
-
-      data.emplace_back( (x+1.5) * stepX, (y + 0.5) * stepY );
-      data.emplace_back( (x+1.5) * stepX, (y + 1.5) * stepY );
-      data.emplace_back( (x+0.5) * stepX, (y + 1.5) * stepY );
-    }
+  // vertices are generated from the pixel index, the vertex array only holds the index buffer
+  std::size_t max_indices = std::size_t(m_tex_width - 1) * (m_tex_height - 1) * 6;
+  m_buffer_indices->setData(max_indices * m_num_kinects * sizeof(unsigned), nullptr, GL_DYNAMIC_COPY);
+  m_tri_grid->bind();
+  m_buffer_indices->bind(GL_ELEMENT_ARRAY_BUFFER);
+  globjects::VertexArray::unbind();
+  // count, instance count, first index, base vertex and base instance per camera
+  for (unsigned i = 0; i < m_num_kinects; ++i) {
+    m_commands_empty.insert(m_commands_empty.end(), {0u, 1u, unsigned(max_indices * i), 0u, 0u});
   }
-
-  m_tri_buffer->setData(data, GL_STATIC_DRAW);
-
-  m_tri_grid->enable(0);
-  m_tri_grid->binding(0)->setAttribute(0);
-  m_tri_grid->binding(0)->setBuffer(m_tri_buffer, 0, sizeof(glm::fvec2));
-  m_tri_grid->binding(0)->setFormat(2, GL_FLOAT);
+  setNumViews(m_num_views);
+  m_buffer_commands->setData(m_commands_empty, GL_DYNAMIC_COPY);
+  // position and depth, texture coordinates and quality per pixel
+  std::size_t vertices_size = std::size_t(m_tex_width) * m_tex_height * m_num_kinects * 8 * sizeof(float);
+  m_buffer_vertices->setData(vertices_size, nullptr, GL_DYNAMIC_COPY);
+  std::cout << "trigrid " << m_tex_width << "x" << m_tex_height << " - index buffer of "
+            << max_indices * m_num_kinects * sizeof(unsigned) / 1048576 << " MB for compacted triangles, "
+            << vertices_size / 1048576 << " MB for calibrated vertices" << std::endl;
 
   reload();
-  
-  resize(600, 480);
 }
 
 ReconTrigrid::~ReconTrigrid() {
   m_tri_grid->destroy();
-  m_tri_buffer->destroy();
+  m_buffer_indices->destroy();
+  m_buffer_commands->destroy();
+  m_buffer_vertices->destroy();
+  m_program_compact->destroy();
   m_program_accum->destroy();
   m_program_normalize->destroy();
 }
 
+void ReconTrigrid::compactTriangles(std::vector<View> const& views) {
+  m_timer_stages.start("compact");
+  m_buffer_commands->setSubData(0, m_commands_empty.size() * sizeof(unsigned), m_commands_empty.data());
+  m_buffer_commands->bindBase(GL_SHADER_STORAGE_BUFFER, 7);
+  m_buffer_indices->bindBase(GL_SHADER_STORAGE_BUFFER, 8);
+  m_buffer_vertices->bindBase(GL_SHADER_STORAGE_BUFFER, 15);
+  // frusta of the views in world space, a tile is kept if any view sees it
+  std::vector<glm::fvec4> planes{};
+  std::vector<glm::fvec3> viewer_positions{};
+  for (auto const& view : views) {
+    m_culler.Calculate(glm::value_ptr(view.projection), glm::value_ptr(view.modelview));
+    for (int i = 0; i < 6; ++i) {
+      planes.push_back(glm::make_vec4(m_culler.getPlane(i)));
+    }
+    viewer_positions.push_back(glm::fvec3{glm::inverse(view.modelview) * glm::fvec4{0.0f, 0.0f, 0.0f, 1.0f}});
+  }
+  m_program_compact->setUniform("frustum_planes", planes);
+  m_program_compact->setUniform("viewer_pos", viewer_positions);
+  m_program_compact->setUniform("num_views", unsigned(views.size()));
+  m_program_compact->use();
+  m_program_compact->dispatchCompute((m_tex_width + 6) / 8, (m_tex_height + 6) / 8, m_num_kinects);
+  m_program_compact->release();
+  // vertices are read from the storage buffer by the vertex shader
+  glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+  m_timer_stages.stop("compact");
+}
+
 void ReconTrigrid::draw(){
-  // calculate img_to_eye for this view
-  gloost::Matrix projection_matrix;
-  glGetFloatv(GL_PROJECTION_MATRIX, projection_matrix.data());
-  gloost::Matrix viewport_translate;
-  viewport_translate.setIdentity();
-  viewport_translate.setTranslate(1.0,1.0,1.0);
-  gloost::Matrix viewport_scale;
-  viewport_scale.setIdentity();
-  unsigned width  = 0;
-  unsigned height = 0;
-  getWidthHeight(width, height);
-  viewport_scale.setScale(width * 0.5, height * 0.5, 0.5f);
-  gloost::Matrix image_to_eye =  viewport_scale * viewport_translate * projection_matrix;
-  image_to_eye.invert();
-
-  unsigned ox;
-  unsigned oy;
-  // cull in the geometry shader
-  glDisable(GL_CULL_FACE);
-// pass 1 goes to depth buffer only
-  m_va_pass_depth->enable(0, false, &ox, &oy, false);
+  // single view from the current gl state
+  View view{};
+  glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(view.modelview));
+  glGetFloatv(GL_PROJECTION_MATRIX, glm::value_ptr(view.projection));
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  view.viewport = glm::uvec4{viewport[0], viewport[1], viewport[2], viewport[3]};
+  drawViews({view});
+}
 
-  m_program_accum->use();
-  m_program_accum->setUniform("stage", 0u);
+void ReconTrigrid::drawViews(std::vector<View> const& views){
+  if (views.empty() || views.size() > s_max_views) {
+    throw std::invalid_argument{"trigrid renders 1 to " + std::to_string(s_max_views) + " views"};
+  }
+  unsigned width  = views[0].viewport.z;
+  unsigned height = views[0].viewport.w;
+  for (auto const& view : views) {
+    if (view.viewport.z != width || view.viewport.w != height) {
+      throw std::invalid_argument{"trigrid views need viewports of the same size"};
+    }
+  }
+  if (views.size() != m_num_views) {
+    setNumViews(unsigned(views.size()));
+  }
 
-  for(unsigned layer = 0; layer < m_num_kinects; ++layer){
-    m_program_accum->setUniform("layer",  layer);
+  compactTriangles(views);
+  // transient targets, larger than the viewport after shrinking the window
+  mvt::ViewArray* va_pass_depth = mvt::RenderTargetPool::get()->acquire(width, height, m_num_views);
+  mvt::ViewArray* va_pass_accum = mvt::RenderTargetPool::get()->acquire(width, height, m_num_views);
 
-    m_tri_grid->drawArrays(GL_TRIANGLES, 0, m_tex_width * m_tex_height * 6);
+  // calculate img_to_eye for each view
+  std::vector<glm::fmat4> modelviews{};
+  std::vector<glm::fmat4> projections{};
+  std::vector<glm::fmat4> images_to_eye{};
+  glm::fmat4 viewport_translate{glm::translate(glm::fmat4{}, glm::fvec3{1.0f})};
+  glm::fmat4 viewport_scale{glm::scale(glm::fmat4{}, glm::fvec3{width * 0.5f, height * 0.5f, 0.5f})};
+  for (auto const& view : views) {
+    modelviews.push_back(view.modelview);
+    projections.push_back(view.projection);
+    images_to_eye.push_back(glm::inverse(viewport_scale * viewport_translate * view.projection));
   }
 
-  m_va_pass_depth->disable(false);
+  GLint viewport_parent[4];
+  glGetIntegerv(GL_VIEWPORT, viewport_parent);
+  // invalid triangles were removed by the compaction
+  glDisable(GL_CULL_FACE);
+// pass 1 goes to depth buffer only
+  m_program_accum->use();
+  m_program_accum->setUniform("stage", 0u);
+  m_program_accum->setUniform("view_modelview", modelviews);
+  m_program_accum->setUniform("view_projection", projections);
+
+  m_buffer_commands->bind(GL_DRAW_INDIRECT_BUFFER);
+  drawLayers(va_pass_depth, glm::uvec2{width, height}, false);
 
 // pass 2 goes to accumulation buffer
   glDisable(GL_DEPTH_TEST);
   glEnable(GL_BLEND); 
   glBlendFuncSeparateEXT(GL_ONE,GL_ONE,GL_ONE,GL_ONE);
   glBlendEquationSeparateEXT(GL_FUNC_ADD, GL_FUNC_ADD);
-  m_va_pass_accum->enable(0, false, &ox, &oy);
   m_program_accum->setUniform("stage", 1u);
-  m_program_accum->setUniform("viewportSizeInv", glm::fvec2(1.0f/m_va_pass_depth->getWidth(), 1.0f/m_va_pass_depth->getHeight()));
-  m_program_accum->setUniform("img_to_eye_curr", image_to_eye);
+  m_program_accum->setUniform("viewportSizeInv", glm::fvec2(1.0f/va_pass_depth->getWidth(), 1.0f/va_pass_depth->getHeight()));
+  m_program_accum->setUniform("img_to_eye_curr", images_to_eye);
   
-  m_va_pass_depth->bindToTextureUnitDepth(14);
+  va_pass_depth->bindToTextureUnitDepth(14);
 
-  for(unsigned layer = 0; layer < m_num_kinects; ++layer){
-    m_program_accum->setUniform("layer",  layer);
-
-    m_tri_grid->drawArrays(GL_TRIANGLES, 0, m_tex_width * m_tex_height * 6);
-  }
+  drawLayers(va_pass_accum, glm::uvec2{width, height}, true);
 
   m_program_accum->release();
-  m_va_pass_accum->disable(false);
   glDisable(GL_BLEND);
 
-// normalize pass outputs best quality color and depth to framebuffer of parent renderstage
+// normalize pass outputs best quality color and depth of each view to its viewport in the framebuffer of parent renderstage
   glEnable(GL_DEPTH_TEST);
 
   m_program_normalize->use();
-  m_program_normalize->setUniform("texSizeInv", glm::fvec2(1.0f/m_va_pass_depth->getWidth(), 1.0f/m_va_pass_depth->getHeight()));
-  m_program_normalize->setUniform("offset"    , glm::fvec2(1.0f*ox,                          1.0f*oy));
+  m_program_normalize->setUniform("texSizeInv", glm::fvec2(1.0f/va_pass_depth->getWidth(), 1.0f/va_pass_depth->getHeight()));
   
-  m_va_pass_accum->bindToTextureUnitRGBA(15);
-  m_va_pass_depth->bindToTextureUnitDepth(16);
+  va_pass_accum->bindToTextureUnitRGBA(15);
+  va_pass_depth->bindToTextureUnitDepth(16);
   
-  ScreenQuad::draw();
+  for (unsigned i = 0; i < views.size(); ++i) {
+    glm::uvec4 const& viewport = views[i].viewport;
+    glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+    m_program_normalize->setUniform("offset", glm::fvec2(1.0f*viewport.x, 1.0f*viewport.y));
+    m_program_normalize->setUniform("layer" , float(i));
+    ScreenQuad::draw();
+  }
 
   m_program_normalize->release();
+  glViewport(viewport_parent[0], viewport_parent[1], viewport_parent[2], viewport_parent[3]);
+  mvt::RenderTargetPool::get()->release(va_pass_depth);
+  mvt::RenderTargetPool::get()->release(va_pass_accum);
+}
+
+void ReconTrigrid::drawLayers(mvt::ViewArray* target, glm::uvec2 const& size, bool clearcolor) {
+  if (m_layered) {
+    target->enableLayered(clearcolor);
+    glViewport(0, 0, size.x, size.y);
+    m_tri_grid->multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, m_num_kinects, 0);
+    target->disableLayered();
+    return;
+  }
+  // the commands hold a single instance, the offset selects the view
+  for (unsigned i = 0; i < m_num_views; ++i) {
+    target->enable(i, true, 0, 0, clearcolor);
+    glViewport(0, 0, size.x, size.y);
+    m_program_accum->setUniform("view_offset", i);
+    m_tri_grid->multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, m_num_kinects, 0);
+    target->disable();
+  }
+  m_program_accum->setUniform("view_offset", 0u);
 }
 
-void ReconTrigrid::resize(std::size_t width, std::size_t height) {
-  m_va_pass_depth = std::unique_ptr<mvt::ViewArray>{new mvt::ViewArray(width, height, 1)};
-  m_va_pass_depth->init();
+void ReconTrigrid::setNumViews(unsigned num_views) {
+  m_num_views = num_views;
+  // one instance per view when they are drawn at once
+  for (unsigned i = 0; i < m_num_kinects; ++i) {
+    m_commands_empty[i * 5 + 1] = m_layered ? m_num_views : 1u;
+  }
+}
 
-  m_va_pass_accum = std::unique_ptr<mvt::ViewArray>{new mvt::ViewArray(width, height, 1)};
-  m_va_pass_accum->init();
+void ReconTrigrid::setBackfaceCulling(bool active) {
+  m_cull_backfaces = active;
+  m_program_compact->setUniform("cull_backfaces", unsigned(m_cull_backfaces));
 }
 
+bool ReconTrigrid::isBackfaceCulling() const {
+  return m_cull_backfaces;
+}
+
+
 }
\ No newline at end of file
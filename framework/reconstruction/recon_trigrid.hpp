@@ -2,31 +2,65 @@
 #define RECON_TRIGRID_HPP
 
 #include "reconstruction.hpp"
-#include "ViewArray.h"
+#include "frustumCulling.h"
 
 #include <globjects/Buffer.h>
 #include <globjects/Program.h>
 #include <globjects/VertexArray.h>
+#include <glm/gtc/type_precision.hpp>
+
+#include <vector>
+
+namespace mvt{
+  class ViewArray;
+}
 
 namespace kinect{
 
   class ReconTrigrid : public Reconstruction {
 
   public:
+    // viewpoint of multi-view rendering, the viewport is in the target framebuffer
+    struct View {
+      glm::fmat4 modelview;
+      glm::fmat4 projection;
+      glm::uvec4 viewport;
+    };
+    static std::size_t const s_max_views = 4;
+
     ReconTrigrid(CalibrationFiles const& cfs, CalibVolumes const* cv, gloost::BoundingBox const&  bbox);
     ~ReconTrigrid();
     
     void draw() override;
+    // renders all views at once, triangles are compacted once and drawn instanced into one layer per view
+    // all viewports need the same size
+    void drawViews(std::vector<View> const& views);
 
-    void resize(std::size_t width, std::size_t height) override;
+    // drop tiles whose triangles all face away from the viewer
+    void setBackfaceCulling(bool active);
+    bool isBackfaceCulling() const;
 
   private:
-    std::unique_ptr<mvt::ViewArray>     m_va_pass_depth;
-    std::unique_ptr<mvt::ViewArray>     m_va_pass_accum;
+    // culls triangles and calibrates their vertices once per frame for both passes and all views
+    void compactTriangles(std::vector<View> const& views);
+    void setNumViews(unsigned num_views);
+    // all views at once if the vertex shader can select the layer, one draw per view otherwise
+    void drawLayers(mvt::ViewArray* target, glm::uvec2 const& size, bool clearcolor);
+
+    unsigned                            m_num_views;
+    bool                                m_layered;
 
     globjects::VertexArray*              m_tri_grid;
-    globjects::Buffer*                  m_tri_buffer;
+    // surviving triangles of all cameras and one indirect draw per camera
+    globjects::Buffer*                   m_buffer_indices;
+    globjects::Buffer*                   m_buffer_commands;
+    // calibrated vertices of the cameras, looked up once for all views
+    globjects::Buffer*                   m_buffer_vertices;
+    std::vector<unsigned>                m_commands_empty;
+    frustumCulling                       m_culler;
+    bool                                 m_cull_backfaces;
 
+    globjects::Program*                  m_program_compact;
     globjects::Program*                  m_program_accum;
     globjects::Program*                  m_program_normalize;
   };
@@ -13,6 +13,7 @@ Reconstruction::Reconstruction(CalibrationFiles const& cfs, CalibVolumes const*
  ,m_num_kinects{cfs.num()}
  ,m_min_length{cfs.minLength()}
  ,m_bbox{bbox}
+ ,m_timer_stages{}
 {}
 
 void Reconstruction::reload() {
@@ -22,4 +23,8 @@ void Reconstruction::reload() {
 void  Reconstruction::resize(std::size_t width, std::size_t height) {
 }
 
+std::vector<std::pair<std::string, double>> const& Reconstruction::getStageTimes() {
+  return m_timer_stages.get();
+}
+
 }
\ No newline at end of file
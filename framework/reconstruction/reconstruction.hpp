@@ -2,6 +2,11 @@
 #define RECONSTRUCTION_HPP
 
 #include "gloost/BoundingBox.h"
+#include <GPUStageTimer.h>
+
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace kinect{
 
@@ -19,6 +24,9 @@ namespace kinect{
     // mustnt be implemented by children without fbos
     virtual void resize(std::size_t width, std::size_t height);
 
+    // gpu time in ms of the draw stages, from the latest finished frame
+    std::vector<std::pair<std::string, double>> const& getStageTimes();
+
   protected:
     CalibVolumes const* m_cv;
     CalibrationFiles const* m_cf;
@@ -28,6 +36,8 @@ namespace kinect{
     unsigned m_num_kinects;
     float m_min_length;
     gloost::BoundingBox m_bbox;
+
+    sensor::GPUStageTimer m_timer_stages;
   };
 }
 
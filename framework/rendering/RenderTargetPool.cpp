@@ -0,0 +1,87 @@
+#include "RenderTargetPool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace mvt{
+
+// window resizes within a bucket reuse the targets
+static unsigned bucket_size = 256;
+
+RenderTargetPool* RenderTargetPool::s_instance = 0;
+
+RenderTargetPool*
+RenderTargetPool::get(){
+  // never destroyed, targets would outlive the context
+  if(!s_instance){
+    s_instance = new RenderTargetPool();
+  }
+  return s_instance;
+}
+
+RenderTargetPool::RenderTargetPool()
+  : m_targets()
+{}
+
+ViewArray*
+RenderTargetPool::acquire(unsigned width, unsigned height, unsigned num_layers){
+  // smallest free target which is large enough
+  Target* best = 0;
+  for(auto& target : m_targets){
+    ViewArray& va = *target.view_array;
+    if(target.in_use || va.getNumLayers() != num_layers || va.getWidth() < width || va.getHeight() < height){
+      continue;
+    }
+    if(!best || va.getWidth() * va.getHeight() < best->view_array->getWidth() * best->view_array->getHeight()){
+      best = &target;
+    }
+  }
+  if(best){
+    best->in_use = true;
+    return best->view_array.get();
+  }
+
+  // free targets of this layer count are too small for the new size, replace them
+  m_targets.erase(std::remove_if(m_targets.begin(), m_targets.end(), [num_layers](Target const& target){
+    return !target.in_use && target.view_array->getNumLayers() == num_layers;
+  }), m_targets.end());
+
+  unsigned target_width = bucketSize(width);
+  unsigned target_height = bucketSize(height);
+  std::cout << "render target pool - allocating " << target_width << "x" << target_height
+            << " with " << num_layers << " layers" << std::endl;
+  m_targets.push_back(Target{std::unique_ptr<ViewArray>{new ViewArray(target_width, target_height, num_layers)}, true});
+  m_targets.back().view_array->init();
+  return m_targets.back().view_array.get();
+}
+
+void
+RenderTargetPool::release(ViewArray* view_array){
+  for(auto& target : m_targets){
+    if(target.view_array.get() == view_array){
+      target.in_use = false;
+      return;
+    }
+  }
+  throw std::invalid_argument{"render target is not from this pool"};
+}
+
+void
+RenderTargetPool::clear(){
+  m_targets.erase(std::remove_if(m_targets.begin(), m_targets.end(), [](Target const& target){
+    return !target.in_use;
+  }), m_targets.end());
+}
+
+std::size_t
+RenderTargetPool::getNumTargets() const{
+  return m_targets.size();
+}
+
+unsigned
+RenderTargetPool::bucketSize(unsigned size){
+  return std::max(1u, (size + bucket_size - 1) / bucket_size) * bucket_size;
+}
+
+}
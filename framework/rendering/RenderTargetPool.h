@@ -0,0 +1,44 @@
+#ifndef MVT_RENDERTARGETPOOL_H
+#define MVT_RENDERTARGETPOOL_H
+
+#include "ViewArray.h"
+
+#include <memory>
+#include <vector>
+
+namespace mvt{
+
+  // singleton, hands out layered color and depth targets for the duration of a draw
+  // sizes are rounded up to buckets, smaller viewports render to a sub-region
+  class RenderTargetPool{
+
+  public:
+    static RenderTargetPool* get();
+
+    // target of at least the given size with exactly num_layers layers
+    ViewArray* acquire(unsigned width, unsigned height, unsigned num_layers);
+    void release(ViewArray* target);
+
+    // frees all targets not in use
+    void clear();
+
+    std::size_t getNumTargets() const;
+
+  private:
+    RenderTargetPool();
+
+    struct Target{
+      std::unique_ptr<ViewArray> view_array;
+      bool in_use;
+    };
+
+    static unsigned bucketSize(unsigned size);
+
+    static RenderTargetPool* s_instance;
+
+    std::vector<Target> m_targets;
+  };
+
+}
+
+#endif // #ifndef MVT_RENDERTARGETPOOL_H
@@ -75,6 +75,28 @@ ViewArray::disable(bool use_vp){
   }
 }
 
+void ViewArray::enableLayered(bool clearcolor) {
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_current_fbo);
+
+  m_fbo->bind();
+  m_fbo->attachTexture(GL_COLOR_ATTACHMENT0, m_colorArray.getTexture(), 0);
+  m_fbo->attachTexture(GL_DEPTH_ATTACHMENT, m_depthArray.getTexture(), 0);
+
+  // clears every layer of a layered attachment
+  if(clearcolor) {
+    glClearColor(0.0,0.0,0.0,0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  }
+  else {
+    glClear(GL_DEPTH_BUFFER_BIT);
+  }
+}
+
+void
+ViewArray::disableLayered(){
+  glBindFramebuffer(GL_FRAMEBUFFER_EXT, m_current_fbo);
+}
+
 void
 ViewArray::bindToTextureUnits(unsigned start_texture_unit){
   glActiveTexture(GL_TEXTURE0 + start_texture_unit);
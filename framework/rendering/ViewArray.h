@@ -20,6 +20,9 @@ namespace mvt{
     void init();
     void enable(unsigned layer, bool use_vp = true, unsigned* ox = 0, unsigned* oy = 0, bool clearcolor = true);
     void disable(bool use_vp = true);
+    // attaches all layers, geometry selects its layer through gl_Layer, the viewport is left to the caller
+    void enableLayered(bool clearcolor = true);
+    void disableLayered();
 
     void bindToTextureUnits(unsigned start_texture_unit);
     void bindToTextureUnitDepth(unsigned start_texture_unit);
@@ -18,7 +18,7 @@ frustumCulling::~frustumCulling()
 void
 frustumCulling::NormalizePlane(int plane){
 
-  GLfloat magnitude = sqrtf( (powf(2, frustum[plane][A]) + powf(2, frustum[plane][B]) + powf(2, frustum[plane][C])) );
+  GLfloat magnitude = sqrtf( (powf(frustum[plane][A], 2) + powf(frustum[plane][B], 2) + powf(frustum[plane][C], 2)) );
   //std::cerr << "magnitude " << magnitude<< std::endl;
   frustum[plane][A] = frustum[plane][A] / magnitude;
   frustum[plane][B] = frustum[plane][B] / magnitude;
@@ -99,6 +99,11 @@ frustumCulling::IsBoxWithin(const float& minx, const float& miny, const float& m
 
 
 
+float const*
+frustumCulling::getPlane(int plane) const{
+  return frustum[plane];
+}
+
 float*
 frustumCulling::getProjM(void){
   return ProjM;
@@ -111,13 +116,20 @@ frustumCulling::getModM(void){
 
 void
 frustumCulling::Calculate(void){
+  GLfloat projection[16];
+  GLfloat modelview[16];
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+  Calculate(projection, modelview);
+}
 
-  
-
-  glGetFloatv(GL_PROJECTION_MATRIX, ProjM);
-  glGetFloatv(GL_MODELVIEW_MATRIX, ModM);
+void
+frustumCulling::Calculate(const float* projection, const float* modelview){
 
-  
+  for(int i=0; i<16; i++){
+    ProjM[i] = projection[i];
+    ModM[i] = modelview[i];
+  }
 
   Clip[ 0] = ModM[ 0]*ProjM[ 0] + ModM[ 1]*ProjM[ 4] + ModM[ 2]*ProjM[ 8] + ModM[ 3]*ProjM[12];
   Clip[ 1] = ModM[ 0]*ProjM[ 1] + ModM[ 1]*ProjM[ 5] + ModM[ 2]*ProjM[ 9] + ModM[ 3]*ProjM[13];
@@ -24,6 +24,11 @@ class frustumCulling{
 #endif
     float getDistance(const float& X, const float& Y, const float& Z);
     void Calculate(void);
+    // column major matrices instead of the current gl state
+    void Calculate(const float* projection, const float* modelview);
+
+    // A, B, C, D of a normalized plane pointing inwards, in object space of the modelview
+    float const* getPlane(int plane) const;
 
     float* getProjM(void);
     float* getModM(void);
@@ -3,20 +3,22 @@
 
 #include <glm/gtc/type_precision.hpp>
 
-#include <globjects/Buffer.h>
 #include <globjects/VertexArray.h>
 
+// draws one point per voxel without vertex data,
+// shaders derive the voxel from gl_VertexID with x varying fastest
 class VolumeSampler {
  public:
   VolumeSampler(glm::uvec3 dimensions);
   ~VolumeSampler();
   
   void sample();
+
+  glm::uvec3 const& dimensions() const;
   
  private:
   glm::uvec3              m_dimensions;
   globjects::VertexArray* m_va_samples;
-  globjects::Buffer*      m_buffer_samples;
 };
 
-#endif //VOLUME_SAMPLER_HPP
\ No newline at end of file
+#endif //VOLUME_SAMPLER_HPP
@@ -0,0 +1,62 @@
+// decoding of the calibration volumes, included by every shader sampling them
+// define CALIB_ANALYTIC before the include to evaluate the fitted models when enabled
+uniform sampler3D[5] cv_xyz;
+uniform sampler3D[5] cv_uv;
+uniform vec2[5] cv_depth_limits;
+uniform mat4[5] cv_xyz_model;
+uniform mat4[5] cv_uv_model;
+uniform vec3[5] cv_xyz_scale;
+uniform vec2[5] cv_uv_scale;
+
+#ifdef CALIB_ANALYTIC
+// fitted polynomials, 20 terms per camera, replace the volume lookups when enabled
+layout(std140) uniform CalibModels {
+  vec4 cv_xyz_poly[100];
+  vec4 cv_uv_poly[100];
+  uint cv_analytic;
+};
+uniform sampler3D[5] cv_xyz_grid;
+uniform sampler3D[5] cv_uv_grid;
+
+float[20] poly_terms(const in vec3 coords) {
+  vec3 p = coords * 2.0 - 1.0;
+  return float[20](1.0, p.x, p.y, p.z,
+    p.x * p.x, p.x * p.y, p.x * p.z, p.y * p.y, p.y * p.z, p.z * p.z,
+    p.x * p.x * p.x, p.x * p.x * p.y, p.x * p.x * p.z, p.x * p.y * p.y, p.x * p.y * p.z,
+    p.x * p.z * p.z, p.y * p.y * p.y, p.y * p.y * p.z, p.y * p.z * p.z, p.z * p.z * p.z);
+}
+#endif
+
+// volumes store residuals against a pinhole model, float volumes have a zero model
+vec4 pinhole_basis(const in uint i, const in vec3 coords) {
+  float z = mix(cv_depth_limits[i].x, cv_depth_limits[i].y, coords.z);
+  return vec4(coords.xy * z, z, 1.0);
+}
+
+vec3 sample_xyz(const in uint i, const in vec3 coords) {
+#ifdef CALIB_ANALYTIC
+  if (cv_analytic > 0u) {
+    float[20] terms = poly_terms(coords);
+    vec3 value = texture(cv_xyz_grid[i], coords).xyz;
+    for (uint k = 0u; k < 20u; ++k) {
+      value += cv_xyz_poly[i * 20u + k].xyz * terms[k];
+    }
+    return value;
+  }
+#endif
+  return texture(cv_xyz[i], coords).xyz * cv_xyz_scale[i] + (cv_xyz_model[i] * pinhole_basis(i, coords)).xyz;
+}
+
+vec2 sample_uv(const in uint i, const in vec3 coords) {
+#ifdef CALIB_ANALYTIC
+  if (cv_analytic > 0u) {
+    float[20] terms = poly_terms(coords);
+    vec2 value = texture(cv_uv_grid[i], coords).xy;
+    for (uint k = 0u; k < 20u; ++k) {
+      value += cv_uv_poly[i * 20u + k].xy * terms[k];
+    }
+    return value;
+  }
+#endif
+  return texture(cv_uv[i], coords).xy * cv_uv_scale[i] + (cv_uv_model[i] * pinhole_basis(i, coords)).xy;
+}
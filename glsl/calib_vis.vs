@@ -1,10 +1,10 @@
 #version 430
+#extension GL_ARB_shading_language_include : require
 
-in vec3 in_Position; 
 
 uniform uint layer;
-uniform sampler3D[5] cv_xyz;
-uniform sampler3D[5] cv_uv;
+#define CALIB_ANALYTIC
+#include "/calib_decode.glsl"
 
 uniform sampler3D[5] cv_xyz_inv;
 uniform sampler3D[5] cv_uv_inv;
@@ -14,6 +14,7 @@ uniform sampler3D volume_tsdf;
 uniform mat4 gl_ModelViewMatrix;
 uniform mat4 gl_ProjectionMatrix;
 uniform mat4 vol_to_world;
+uniform uvec3 res_volume;
 
 flat out vec3 geo_pos_volume;
 flat out vec3 geo_pos_world;
@@ -21,9 +22,12 @@ flat out vec3 geo_pos_view;
 flat out vec2 geo_texcoord;
 
 void main() {
-  geo_pos_volume = in_Position;
+  // voxel of this vertex, x varies fastest
+  uint index = uint(gl_VertexID);
+  uvec3 voxel = uvec3(index % res_volume.x, (index / res_volume.x) % res_volume.y, index / (res_volume.x * res_volume.y));
+  geo_pos_volume = (vec3(voxel) + 0.5f) / vec3(res_volume);
   vec3 pos_calib  = texture(cv_xyz_inv[layer], geo_pos_volume).rgb;
-  vec3 pos_vol  = texture(cv_xyz[layer], pos_calib).rgb;
+  vec3 pos_vol  = sample_xyz(layer, pos_calib);
   // pos_calib = geo_pos_volume;
   geo_pos_world  = (vol_to_world * vec4(geo_pos_volume, 1.0)).xyz;
   // geo_pos_world  = (vol_to_world * vec4(pos_vol, 1.0)).xyz;
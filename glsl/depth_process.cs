@@ -0,0 +1,271 @@
+#version 430
+#extension GL_ARB_shading_language_include : require
+// filtered depth, quality and normal of a tile in one pass, one workgroup layer per camera
+// same results as depth_process.fs followed by normal_computation.fs
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+uniform sampler2DArray kinect_depths;
+#define CALIB_ANALYTIC
+#include "/calib_decode.glsl"
+
+layout(r32f) uniform writeonly image2DArray out_depth;
+layout(r32f) uniform writeonly image2DArray out_quality;
+layout(rgba32f) uniform writeonly image2DArray out_normal;
+
+uniform uvec2 res_depth;
+uniform bool filter_textures;
+uniform uint[5] compress;
+uniform float[5] scale;
+uniform float[5] near;
+// separable approximation of the bilateral filter, 2 x 13 instead of 13 x 13 taps
+uniform bool separable;
+// accumulates the difference of the separable approximation to the full filter
+uniform bool compare;
+
+// depth in 0.1mm
+layout(std430, binding = 12) buffer FilterError {
+  uint num_valid;
+  uint num_mismatch;
+  uint sum_depth_error;
+  uint max_depth_error;
+  uint sum_quality_error;
+};
+
+const int kernel_size = 6; // in pixel
+// normals need the filtered depth of the direct neighbours
+const int apron = kernel_size + 1;
+const int tile_size = 16;
+const int raw_size = tile_size + 2 * apron;
+const int filtered_size = tile_size + 2;
+
+shared float raw_depths[raw_size * raw_size];
+shared float filtered_depths[filtered_size * filtered_size];
+// horizontal pass of the separable filter for all raw rows and the filtered columns
+shared float row_depths[raw_size * filtered_size];
+shared float row_borders[raw_size * filtered_size];
+shared float row_ranges[raw_size * filtered_size];
+
+float uncompress(const in uint layer, const in float d_c){
+  float scaled_near = scale[layer] / 255.0f;
+  if(d_c < scaled_near){
+    return 0.0;
+  }
+  // sqrt-mapping
+  return (d_c * d_c + 0.15 * scaled_near) * scale[layer] + near[layer];
+}
+
+// clamp to edge like the texture lookups of the fragment passes
+float sample_raw(const in uint layer, const in ivec2 pixel) {
+  float depth = texelFetch(kinect_depths, ivec3(clamp(pixel, ivec2(0), ivec2(res_depth) - 1), layer), 0).r;
+  return compress[layer] > 0u ? uncompress(layer, depth) : depth;
+}
+
+bool is_outside(const in uint layer, const in float d){
+  return (d < cv_depth_limits[layer].x) || (d > cv_depth_limits[layer].y);
+}
+
+float normalize_depth(const in uint layer, const in float depth) {
+  return (depth - cv_depth_limits[layer].x) / (cv_depth_limits[layer].y - cv_depth_limits[layer].x);
+}
+
+// center in coordinates of the raw tile
+vec2 bilateral_filter(const in uint layer, const in ivec2 center){
+  float depth = raw_depths[center.y * raw_size + center.x];
+  if(is_outside(layer, depth)){
+    return vec2(-1.0,0.0);
+  }
+  // the valid range scales with depth
+  const float max_depth = 4.5f; // Kinect V2
+  float dist_range_max = 0.35f * depth / max_depth;
+  float dist_range_max_inv = 1.0f / dist_range_max;
+
+  float depth_bf = 0.0f;
+  float w = 0.0f;
+  float w_range = 0.0f;
+  float border_samples = 0.0f;
+  float num_samples = 0.0f;
+  for(int y = -kernel_size; y <= kernel_size; ++y){
+    for(int x = -kernel_size; x <= kernel_size; ++x){
+      num_samples += 1.0f;
+      float depth_s = raw_depths[(center.y + y) * raw_size + center.x + x];
+      float depth_range = abs(depth_s - depth);
+      if(is_outside(layer, depth_s) || (depth_range > dist_range_max)){
+        border_samples += 1.0f;
+        continue;
+      }
+      float gauss_space = 1.0f - length(vec2(x, y)) / float(kernel_size);
+      float gauss_range = 1.0f - min(depth_range, dist_range_max) * dist_range_max_inv;
+      float w_s = gauss_space * gauss_range;
+      depth_bf += w_s * depth_s;
+      w += w_s;
+      w_range += gauss_range;
+    }
+  }
+
+  float lateral_quality  = 1.0f - border_samples/num_samples;
+  float filtered_depth = w > 0.0f ? depth_bf / w : -1.0f;
+  if(w_range < (num_samples * 0.65)){
+    filtered_depth = -1.0f;
+  }
+  return vec2(filtered_depth, pow(lateral_quality,30.0));
+}
+
+// horizontal pass, weights and border samples are relative to the center of the row
+void filter_row(const in uint layer, const in ivec2 center, out float depth_row, out float border_samples, out float w_range){
+  depth_row = -1.0f;
+  border_samples = float(2 * kernel_size + 1);
+  w_range = 0.0f;
+  float depth = raw_depths[center.y * raw_size + center.x];
+  if(is_outside(layer, depth)){
+    return;
+  }
+  const float max_depth = 4.5f; // Kinect V2
+  float dist_range_max = 0.35f * depth / max_depth;
+  float dist_range_max_inv = 1.0f / dist_range_max;
+
+  float depth_bf = 0.0f;
+  float w = 0.0f;
+  border_samples = 0.0f;
+  for(int x = -kernel_size; x <= kernel_size; ++x){
+    float depth_s = raw_depths[center.y * raw_size + center.x + x];
+    float depth_range = abs(depth_s - depth);
+    if(is_outside(layer, depth_s) || (depth_range > dist_range_max)){
+      border_samples += 1.0f;
+      continue;
+    }
+    float gauss_space = 1.0f - abs(float(x)) / float(kernel_size);
+    float gauss_range = 1.0f - min(depth_range, dist_range_max) * dist_range_max_inv;
+    depth_bf += gauss_space * gauss_range * depth_s;
+    w += gauss_space * gauss_range;
+    w_range += gauss_range;
+  }
+  if(w > 0.0f){
+    depth_row = depth_bf / w;
+  }
+}
+
+// vertical pass over the row results, rows across an edge count as border samples as a whole
+vec2 separable_filter(const in uint layer, const in ivec2 center){
+  float depth = raw_depths[center.y * raw_size + center.x];
+  if(is_outside(layer, depth)){
+    return vec2(-1.0,0.0);
+  }
+  const float max_depth = 4.5f; // Kinect V2
+  float dist_range_max = 0.35f * depth / max_depth;
+  float dist_range_max_inv = 1.0f / dist_range_max;
+  int column = center.x - apron + 1;
+
+  float depth_bf = 0.0f;
+  float w = 0.0f;
+  float w_range = 0.0f;
+  float border_samples = 0.0f;
+  float num_samples = float((2 * kernel_size + 1) * (2 * kernel_size + 1));
+  for(int y = -kernel_size; y <= kernel_size; ++y){
+    int i = (center.y + y) * filtered_size + column;
+    float depth_s = row_depths[i];
+    float depth_range = abs(depth_s - depth);
+    if(depth_s < 0.0f || (depth_range > dist_range_max)){
+      border_samples += float(2 * kernel_size + 1);
+      continue;
+    }
+    float gauss_space = 1.0f - abs(float(y)) / float(kernel_size);
+    float gauss_range = 1.0f - min(depth_range, dist_range_max) * dist_range_max_inv;
+    depth_bf += gauss_space * gauss_range * depth_s;
+    w += gauss_space * gauss_range;
+    w_range += row_ranges[i] * gauss_range;
+    border_samples += row_borders[i];
+  }
+
+  float lateral_quality  = 1.0f - border_samples/num_samples;
+  float filtered_depth = w > 0.0f ? depth_bf / w : -1.0f;
+  if(w_range < (num_samples * 0.65)){
+    filtered_depth = -1.0f;
+  }
+  return vec2(filtered_depth, pow(lateral_quality,30.0));
+}
+
+void accumulate_error(const in vec2 full, const in vec2 approx) {
+  bool valid_full = full.x > 0.0f;
+  bool valid_approx = approx.x > 0.0f;
+  if(valid_full && valid_approx) {
+    uint error = uint(abs(full.x - approx.x) * 1e4f + 0.5f);
+    atomicAdd(num_valid, 1u);
+    atomicAdd(sum_depth_error, error);
+    atomicMax(max_depth_error, error);
+    atomicAdd(sum_quality_error, uint(abs(full.y - approx.y) * 1e4f + 0.5f));
+  }
+  else if(valid_full != valid_approx) {
+    atomicAdd(num_mismatch, 1u);
+  }
+}
+
+// neighbour depth in the filtered tile, replaced by the center depth if invalid or across an edge
+float neighbour_depth(const in ivec2 local, const in float depth) {
+  float depth_n = filtered_depths[local.y * filtered_size + local.x];
+  // the valid range scales with depth
+  if(depth_n < 0.0f || abs(depth - depth_n) > 1.0f / depth) {
+    return depth;
+  }
+  return depth_n;
+}
+
+void main() {
+  uint layer = gl_WorkGroupID.z;
+  ivec2 origin = ivec2(gl_WorkGroupID.xy) * tile_size;
+
+  for(uint i = gl_LocalInvocationIndex; i < uint(raw_size * raw_size); i += gl_WorkGroupSize.x * gl_WorkGroupSize.y) {
+    ivec2 pixel = origin - apron + ivec2(i % uint(raw_size), i / uint(raw_size));
+    raw_depths[i] = sample_raw(layer, pixel);
+  }
+  barrier();
+
+  if(separable || compare) {
+    for(uint i = gl_LocalInvocationIndex; i < uint(raw_size * filtered_size); i += gl_WorkGroupSize.x * gl_WorkGroupSize.y) {
+      ivec2 center = ivec2(int(i % uint(filtered_size)) + apron - 1, int(i / uint(filtered_size)));
+      filter_row(layer, center, row_depths[i], row_borders[i], row_ranges[i]);
+    }
+  }
+  barrier();
+
+  // tile and a border of one pixel, outside of the image the edge pixels are repeated
+  for(uint i = gl_LocalInvocationIndex; i < uint(filtered_size * filtered_size); i += gl_WorkGroupSize.x * gl_WorkGroupSize.y) {
+    ivec2 local = ivec2(i % uint(filtered_size), i / uint(filtered_size));
+    ivec2 pixel = origin - 1 + local;
+    ivec2 center = clamp(pixel, ivec2(0), ivec2(res_depth) - 1) - origin + apron;
+    vec2 res = separable ? separable_filter(layer, center) : bilateral_filter(layer, center);
+    bool inner = all(greaterThanEqual(local, ivec2(1))) && all(lessThanEqual(local, ivec2(tile_size)));
+    if(compare && inner && all(lessThan(pixel, ivec2(res_depth)))) {
+      accumulate_error(separable ? bilateral_filter(layer, center) : res,
+                       separable ? res : separable_filter(layer, center));
+    }
+    if(!filter_textures) {
+      res.x = raw_depths[center.y * raw_size + center.x];
+    }
+    filtered_depths[i] = normalize_depth(layer, res.x);
+    if(inner && all(lessThan(pixel, ivec2(res_depth)))) {
+      imageStore(out_depth, ivec3(pixel, layer), vec4(filtered_depths[i]));
+      imageStore(out_quality, ivec3(pixel, layer), vec4(res.y));
+    }
+  }
+  barrier();
+
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  if(any(greaterThanEqual(pixel, ivec2(res_depth)))) {
+    return;
+  }
+  ivec2 local = ivec2(gl_LocalInvocationID.xy) + 1;
+  float depth = filtered_depths[local.y * filtered_size + local.x];
+  vec2 tex_size_inv = 1.0f / vec2(res_depth);
+  vec2 tex_pos = (vec2(pixel) + 0.5f) * tex_size_inv;
+
+  vec2 tex_t = tex_pos + vec2(0.0f, tex_size_inv.y);
+  vec2 tex_b = tex_pos - vec2(0.0f, tex_size_inv.y);
+  vec2 tex_l = tex_pos - vec2(tex_size_inv.x, 0.0f);
+  vec2 tex_r = tex_pos + vec2(tex_size_inv.x, 0.0f);
+  vec3 world_t = sample_xyz(layer, vec3(tex_t, neighbour_depth(local + ivec2(0, 1), depth)));
+  vec3 world_b = sample_xyz(layer, vec3(tex_b, neighbour_depth(local - ivec2(0, 1), depth)));
+  vec3 world_l = sample_xyz(layer, vec3(tex_l, neighbour_depth(local - ivec2(1, 0), depth)));
+  vec3 world_r = sample_xyz(layer, vec3(tex_r, neighbour_depth(local + ivec2(1, 0), depth)));
+
+  imageStore(out_normal, ivec3(pixel, layer), vec4(normalize(cross(world_b - world_t, world_l - world_r)), 0.0f));
+}
\ No newline at end of file
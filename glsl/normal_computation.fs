@@ -1,5 +1,7 @@
 #version 130
 #extension GL_ARB_explicit_attrib_location : enable
+#extension GL_ARB_uniform_buffer_object : enable
+#extension GL_ARB_shading_language_include : require
 
 noperspective in vec2 pass_TexCoord;
 
@@ -7,8 +9,8 @@ uniform uint layer;
 uniform sampler2DArray kinect_depths;
 uniform vec2 texSizeInv;
 
-uniform sampler3D[5] cv_xyz;
-uniform sampler3D[5] cv_uv;
+#define CALIB_ANALYTIC
+#include "/calib_decode.glsl"
 
 layout(location = 0) out vec3 out_Normal;
 
@@ -30,10 +32,10 @@ vec3 calculate_normal(const in vec2 tex_pos) {
   if(depth_l < 0.0f || abs(depth - depth_l) > dist_range_max) depth_l = depth;
   float depth_r = texture(kinect_depths, vec3(tex_r, layer)).r;
   if(depth_r < 0.0f || abs(depth - depth_r) > dist_range_max) depth_r = depth;
-  vec3 world_t = texture(cv_xyz[layer], vec3(tex_t, depth_t)).xyz;
-  vec3 world_b = texture(cv_xyz[layer], vec3(tex_b, depth_b)).xyz;
-  vec3 world_l = texture(cv_xyz[layer], vec3(tex_l, depth_l)).xyz;
-  vec3 world_r = texture(cv_xyz[layer], vec3(tex_r, depth_r)).xyz;
+  vec3 world_t = sample_xyz(layer, vec3(tex_t, depth_t));
+  vec3 world_b = sample_xyz(layer, vec3(tex_b, depth_b));
+  vec3 world_l = sample_xyz(layer, vec3(tex_l, depth_l));
+  vec3 world_r = sample_xyz(layer, vec3(tex_r, depth_r));
 
   return normalize(cross(world_b - world_t, world_l - world_r));
 }
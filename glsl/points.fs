@@ -10,10 +10,10 @@ flat in float pass_depth;
 flat in float pass_lateral_quality;
 flat in vec3  normal_es;
 flat in vec4  pass_glpos;
+flat in uint  pass_layer;
 // used by accumulation pass
 uniform sampler2DArray kinect_colors;
 uniform sampler2DArray kinect_qualities;
-uniform uint layer;
 uniform mat4 gl_ProjectionMatrix;
 uniform mat4 gl_ModelViewMatrix;
 
@@ -58,7 +58,7 @@ void main() {
   highp vec4 position_curr = img_to_eye_curr * vec4(gl_FragCoord.xy + vec2(0.5,0.5), 0.0f, 1.0);
   highp vec3 position_curr_es = (position_curr / position_curr.w).xyz;
 
-  highp vec4 color = texture2DArray(kinect_colors, vec3(pass_texcoord, float(layer)));
+  highp vec4 color = texture2DArray(kinect_colors, vec3(pass_texcoord, float(pass_layer)));
   gl_FragColor = vec4(color.rgb, quality);
   // gl_FragColor = vec4(gl_PointCoord, 0.0f, 1.0f);
   //ndc
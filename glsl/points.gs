@@ -10,6 +10,7 @@ flat in vec3 geo_pos_es[];
 flat in vec3 geo_pos_cs[];
 flat in float geo_depth[];
 flat in float geo_lateral_quality[];
+flat in uint geo_layer[];
 ///////////////////////////////////////////////////////////////////////////////
 // output
 ///////////////////////////////////////////////////////////////////////////////
@@ -20,6 +21,7 @@ flat out float pass_depth;
 flat out float pass_lateral_quality;
 flat out vec3  pass_normal_es;
 flat out vec4  pass_glpos;
+flat out uint  pass_layer;
 
 ///////////////////////////////////////////////////////////////////////////////
 // methods 
@@ -53,6 +55,7 @@ void main() {
   pass_lateral_quality = geo_lateral_quality[0];
   pass_depth         = geo_depth[0];
   pass_normal_es     = vec3(1.0f);
+  pass_layer         = geo_layer[0];
   gl_Position   = gl_in[0].gl_Position;
   pass_glpos = gl_Position;
 
@@ -1,13 +1,13 @@
 #version 430
 #extension GL_EXT_texture_array : enable
+#extension GL_ARB_shader_draw_parameters : require
+#extension GL_ARB_shading_language_include : require
 
 in vec2 in_position;
 
 uniform sampler2DArray kinect_depths;
-uniform sampler3D[5] cv_xyz;
-uniform sampler3D[5] cv_uv;
-uniform uint layer;
-
+#define CALIB_ANALYTIC
+#include "/calib_decode.glsl"
 uniform mat4 gl_ModelViewMatrix;
 uniform mat4 gl_ProjectionMatrix;
 
@@ -15,17 +15,20 @@ flat out vec2 geo_texcoord;
 flat out vec3 geo_pos_es;
 flat out vec3 geo_pos_cs;
 flat out float geo_depth;
+flat out uint geo_layer;
 
 void main() {
-
+  // one draw per tile and camera, the base instance is dynamically uniform and may index the volumes
+  uint layer = uint(gl_BaseInstanceARB);
   vec3 coords = vec3(in_position,layer);
   float depth = texture2DArray(kinect_depths, coords).r;
 
   // lookup from calibvolume
-  geo_pos_cs        = texture(cv_xyz[layer], vec3(in_position, depth)).rgb;
+  geo_pos_cs        = sample_xyz(layer, vec3(in_position, depth));
   geo_pos_es        = (gl_ModelViewMatrix * vec4(geo_pos_cs, 1.0)).xyz;
-  geo_texcoord      = texture(cv_uv[layer],  vec3(in_position, depth)).rg;
+  geo_texcoord      = sample_uv(layer, vec3(in_position, depth));
   geo_depth         = depth;
+  geo_layer         = layer;
 
   gl_Position = gl_ProjectionMatrix * gl_ModelViewMatrix * vec4(geo_pos_cs, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,86 @@
+#version 430
+#extension GL_ARB_shading_language_include : require
+// one invocation chooses the point stride of one tile, one workgroup layer per camera
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+uniform sampler2DArray kinect_depths;
+#define CALIB_ANALYTIC
+#include "/calib_decode.glsl"
+
+// count, instance count, first and base instance, the base instance is the camera
+struct DrawCommand {
+  uint count;
+  uint instance_count;
+  uint first;
+  uint base_instance;
+};
+layout(std430, binding = 10) buffer DrawCommands {
+  DrawCommand commands[];
+};
+layout(std430, binding = 11) buffer PointStats {
+  uint num_points;
+};
+
+uniform uvec2 res_depth;
+uniform uvec2 num_tiles;
+uniform uint tile_size;
+// points of a tile are ordered by stride, every stride is a prefix
+uniform uint max_stride;
+uniform vec2 res_target;
+uniform mat4 modelview;
+uniform mat4 projection;
+// as gl_PointSize of points.gs
+uniform float point_size;
+
+vec2 to_screen(const in vec4 pos_clip) {
+  return (pos_clip.xy / pos_clip.w * 0.5f + 0.5f) * res_target;
+}
+
+// largest stride at which neighbouring points still overlap on screen
+uint stride_at(const in uint layer, const in vec2 coords, const in float depth) {
+  vec3 pos_cs = sample_xyz(layer, vec3(coords, depth));
+  vec3 pos_es = (modelview * vec4(pos_cs, 1.0f)).xyz;
+  vec4 pos_clip = projection * vec4(pos_es, 1.0f);
+  if (pos_clip.w <= 0.0f) {
+    return max_stride;
+  }
+  vec2 step = 1.0f / vec2(res_depth);
+  vec4 pos_x = projection * modelview * vec4(sample_xyz(layer, vec3(coords + vec2(step.x, 0.0f), depth)), 1.0f);
+  vec4 pos_y = projection * modelview * vec4(sample_xyz(layer, vec3(coords + vec2(0.0f, step.y), depth)), 1.0f);
+  vec2 center = to_screen(pos_clip);
+  float spacing = max(distance(center, to_screen(pos_x)), distance(center, to_screen(pos_y)));
+  float size = point_size / length(pos_es);
+  uint stride = 1u << findMSB(max(uint(size / max(spacing, 1e-6f)), 1u));
+  return min(stride, max_stride);
+}
+
+void main() {
+  uvec2 tile = gl_GlobalInvocationID.xy;
+  uint layer = gl_WorkGroupID.z;
+  if (any(greaterThanEqual(tile, num_tiles))) {
+    return;
+  }
+  uvec2 tile_min = tile * tile_size;
+  uvec2 tile_dims = min(res_depth - tile_min, uvec2(tile_size));
+
+  // the closest part of the tile needs the densest points, sampled at corners and center
+  uint stride = max_stride;
+  bool valid = false;
+  for (uint s = 0u; s < 5u; ++s) {
+    uvec2 pixel = s < 4u ? tile_min + uvec2(s & 1u, s >> 1u) * (tile_dims - 1u) : tile_min + tile_dims / 2u;
+    vec2 coords = (vec2(pixel) + 0.5f) / vec2(res_depth);
+    float depth = texture(kinect_depths, vec3(coords, float(layer))).r;
+    if (depth > 0.0f) {
+      stride = min(stride, stride_at(layer, coords, depth));
+      valid = true;
+    }
+  }
+  // samples may miss the valid pixels of the tile
+  if (!valid) {
+    stride = 1u;
+  }
+
+  uint count = ((tile_dims.x + stride - 1u) / stride) * ((tile_dims.y + stride - 1u) / stride);
+  commands[(layer * num_tiles.y + tile.y) * num_tiles.x + tile.x].count = count;
+  atomicAdd(num_points, count);
+}
\ No newline at end of file
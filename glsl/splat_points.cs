@@ -0,0 +1,72 @@
+#version 430
+#extension GL_ARB_gpu_shader_int64 : require
+#extension GL_NV_shader_atomic_int64 : require
+#extension GL_ARB_shading_language_include : require
+// one invocation splats one depth pixel, one workgroup layer per camera
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+uniform sampler2DArray kinect_colors;
+uniform sampler2DArray kinect_depths;
+#define CALIB_ANALYTIC
+#include "/calib_decode.glsl"
+
+// window depth in the upper and color in the lower half, the minimum is the closest splat
+layout(std430, binding = 9) buffer Visibility {
+  uint64_t visibility[];
+};
+
+uniform uvec2 res_depth;
+uniform uvec2 res_target;
+uniform mat4 modelview;
+uniform mat4 projection;
+uniform vec3 bbox_min;
+uniform vec3 bbox_max;
+// splat size in pixels at a distance of 1m, as gl_PointSize of points.gs
+uniform float point_size;
+uniform float max_point_size;
+
+bool clip(vec3 p){
+  return any(lessThan(p, bbox_min)) || any(greaterThan(p, bbox_max));
+}
+
+void main() {
+  uvec2 pixel = gl_GlobalInvocationID.xy;
+  uint layer = gl_WorkGroupID.z;
+  if (any(greaterThanEqual(pixel, res_depth))) {
+    return;
+  }
+  vec2 coords = (vec2(pixel) + 0.5f) / vec2(res_depth);
+  float depth = texture(kinect_depths, vec3(coords, float(layer))).r;
+  if (depth <= -1.0f) {
+    return;
+  }
+  vec3 pos_cs = sample_xyz(layer, vec3(coords, depth));
+  if (clip(pos_cs)) {
+    return;
+  }
+  // to cull away borders of the rgb camera view
+  vec2 texcoord = sample_uv(layer, vec3(coords, depth));
+  if (any(greaterThan(texcoord, vec2(0.99f))) || any(lessThan(texcoord, vec2(0.01f)))) {
+    return;
+  }
+
+  vec3 pos_es = (modelview * vec4(pos_cs, 1.0f)).xyz;
+  vec4 pos_clip = projection * vec4(pos_es, 1.0f);
+  vec3 pos_ndc = pos_clip.xyz / pos_clip.w;
+  if (pos_clip.w <= 0.0f || abs(pos_ndc.z) > 1.0f) {
+    return;
+  }
+  vec2 center = (pos_ndc.xy * 0.5f + 0.5f) * vec2(res_target);
+  float size = clamp(point_size / length(pos_es), 1.0f, max_point_size);
+
+  vec3 color = texture(kinect_colors, vec3(texcoord, float(layer))).rgb;
+  uint64_t splat = packUint2x32(uvec2(packUnorm4x8(vec4(color, 1.0f)), floatBitsToUint(pos_ndc.z * 0.5f + 0.5f)));
+  // pixels with their center inside the square, like rasterized points
+  ivec2 first = max(ivec2(ceil(center - 0.5f * size - 0.5f)), ivec2(0));
+  ivec2 last = min(ivec2(floor(center + 0.5f * size - 0.5f)), ivec2(res_target) - 1);
+  for (int y = first.y; y <= last.y; ++y) {
+    for (int x = first.x; x <= last.x; ++x) {
+      atomicMin(visibility[uint(y) * res_target.x + uint(x)], splat);
+    }
+  }
+}
\ No newline at end of file
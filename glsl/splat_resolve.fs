@@ -0,0 +1,22 @@
+#version 430
+#extension GL_ARB_gpu_shader_int64 : require
+
+layout(std430, binding = 9) readonly buffer Visibility {
+  uint64_t visibility[];
+};
+
+uniform uvec2 res_target;
+uniform vec2 offset;
+
+out vec4 out_Color;
+
+void main() {
+  uvec2 pixel = uvec2(gl_FragCoord.xy - offset);
+  uvec2 splat = unpackUint2x32(visibility[pixel.y * res_target.x + pixel.x]);
+  // no splat covers the pixel
+  if (splat.y == 0xFFFFFFFFu) {
+    discard;
+  }
+  out_Color = vec4(unpackUnorm4x8(splat.x).rgb, 1.0f);
+  gl_FragDepth = uintBitsToFloat(splat.y);
+}
\ No newline at end of file
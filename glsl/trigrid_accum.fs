@@ -6,9 +6,8 @@ uniform uint stage;
 // used by accumulation pass
 uniform sampler2DArray kinect_colors;
 uniform sampler2DArray depth_map_curr;
-uniform uint layer;
 
-uniform mat4 img_to_eye_curr;
+uniform mat4 img_to_eye_curr[4];
 uniform vec2 viewportSizeInv;
 uniform float epsilon;
 
@@ -23,7 +22,8 @@ in vec3  pass_pos_cs;
 
 in float pass_depth;
 in float pass_lateral_quality;
-in vec3  pass_normal_es;
+flat in uint pass_layer;
+flat in uint pass_view;
 
 out vec4 gl_FragColor;
 // methods 
@@ -56,7 +56,8 @@ void main() {
    }
 #endif
 
-   vec3 normal = normalize(pass_normal_es);
+   // triangle normal, was passed by the geometry shader before compaction
+   vec3 normal = normalize(cross(dFdx(pass_pos_es), dFdy(pass_pos_es)));
 #if 1
 // backface culling
    if ( dot ( normal, -normalize(pass_pos_es) ) > 0.0 ) {
@@ -71,9 +72,9 @@ void main() {
    float quality = pass_lateral_quality/(pass_depth * 4.0f+ 0.5f);
 
    if(stage > 0u){ // accumulation pass write color and quality if within epsilon
-     vec3  coords = vec3(gl_FragCoord.xy * viewportSizeInv, 0.0 /*here layer is always 0*/);
+     vec3  coords = vec3(gl_FragCoord.xy * viewportSizeInv, float(pass_view));
      float depth_curr = texture2DArray(depth_map_curr, coords).r;
-     vec4  position_curr = img_to_eye_curr * vec4(gl_FragCoord.xy + vec2(0.5,0.5),depth_curr,1.0);
+     vec4  position_curr = img_to_eye_curr[pass_view] * vec4(gl_FragCoord.xy + vec2(0.5,0.5),depth_curr,1.0);
      vec3  position_curr_es = position_curr.xyz / position_curr.w;
      // discard if occluded by triangles in front
      if(epsilon < length(position_curr_es - pass_pos_es)) {
@@ -82,7 +83,7 @@ void main() {
        return;
      }
 
-     vec4 color = texture2DArray(kinect_colors, vec3(pass_texcoord, float(layer)));
+     vec4 color = texture2DArray(kinect_colors, vec3(pass_texcoord, float(pass_layer)));
      gl_FragColor = vec4(color.rgb * quality, quality);
    }
 }
\ No newline at end of file
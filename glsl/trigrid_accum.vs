@@ -1,34 +1,49 @@
 #version 430
-#extension GL_EXT_texture_array : enable
-
-in vec2 in_Position; 
-
-uniform uint layer;
-uniform sampler2DArray kinect_depths;
-uniform sampler2DArray kinect_qualities;
-uniform sampler3D[5] cv_xyz;
-uniform sampler3D[5] cv_uv;
-
-uniform mat4 gl_ModelViewMatrix;
-uniform mat4 gl_ProjectionMatrix;
-
-out vec2 geo_texcoord;
-out vec3 geo_pos_es;
-out vec3 geo_pos_cs;
-out float geo_depth;
-out float geo_lateral_quality;
+#extension GL_ARB_shader_draw_parameters : require
+#extension GL_ARB_shader_viewport_layer_array : enable
+
+uniform uvec2 res_depth;
+// written once per camera by the compaction, only the view transform is done per instance
+struct Vertex {
+  vec4 position_depth;
+  vec4 texcoord_quality;
+};
+layout(std430, binding = 15) readonly buffer Vertices {
+  Vertex vertex_data[];
+};
+
+// one instance per view, each renders to its own layer
+// without layer selection in the vertex shader each view is drawn on its own, starting at the offset
+uniform mat4[4] view_modelview;
+uniform mat4[4] view_projection;
+uniform uint view_offset;
+
+out vec2 pass_texcoord;
+out vec3 pass_pos_es;
+out vec3 pass_pos_cs;
+out float pass_depth;
+out float pass_lateral_quality;
+flat out uint pass_layer;
+flat out uint pass_view;
 
 void main() {
-
-  vec3 coords = vec3(in_Position,layer);
-  float depth = texture2DArray(kinect_depths, coords).r;
-
-  // lookup from calibvolume
-  geo_pos_cs        = texture(cv_xyz[layer], vec3(in_Position, depth)).rgb;
-  geo_pos_es        = (gl_ModelViewMatrix * vec4(geo_pos_cs, 1.0)).xyz;
-  geo_texcoord      = texture(cv_uv[layer],  vec3(in_Position, depth)).rg;
-  geo_depth         = depth;
-  geo_lateral_quality = texture2DArray(kinect_qualities, coords).r;
-
-  gl_Position = gl_ProjectionMatrix * gl_ModelViewMatrix * vec4(geo_pos_cs, 1.0);
+  // one draw per camera, the draw id is dynamically uniform
+  uint layer = uint(gl_DrawIDARB);
+  uint view = view_offset + uint(gl_InstanceID);
+  // indices of the compacted triangles are pixel indices
+  Vertex v = vertex_data[layer * res_depth.x * res_depth.y + uint(gl_VertexID)];
+
+  pass_pos_cs        = v.position_depth.xyz;
+  pass_pos_es        = (view_modelview[view] * vec4(pass_pos_cs, 1.0)).xyz;
+  pass_texcoord      = v.texcoord_quality.xy;
+  pass_depth         = v.position_depth.w;
+  pass_lateral_quality = v.texcoord_quality.z;
+  pass_layer         = layer;
+  pass_view          = view;
+
+  gl_Position = view_projection[view] * vec4(pass_pos_es, 1.0);
+  // without the extension the host binds the layer of each view itself
+#ifdef GL_ARB_shader_viewport_layer_array
+  gl_Layer = int(view);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,191 @@
+#version 430
+#extension GL_ARB_shading_language_include : require
+// one invocation tests the two triangles of one depth pixel quad, one workgroup layer per camera
+// workgroups are screen tiles of a camera, culled as a whole against the view frustum and by facing
+// calibrated vertices of visible tiles are written once for all views
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+uniform sampler2DArray kinect_depths;
+uniform sampler2DArray kinect_qualities;
+#define CALIB_ANALYTIC
+#include "/calib_decode.glsl"
+
+// per camera multi draw command, the triangle count is accumulated here
+struct DrawCommand {
+  uint count;
+  uint instance_count;
+  uint first_index;
+  uint base_vertex;
+  uint base_instance;
+};
+layout(std430, binding = 7) buffer DrawCommands {
+  DrawCommand commands[];
+};
+// three vertex indices per surviving triangle, vertex index is the pixel index
+layout(std430, binding = 8) buffer TriangleIndices {
+  uint indices[];
+};
+// calibrated vertex of every pixel of a visible tile, shared by all views
+struct Vertex {
+  vec4 position_depth;
+  vec4 texcoord_quality;
+};
+layout(std430, binding = 15) buffer Vertices {
+  Vertex vertex_data[];
+};
+
+uniform uvec2 res_depth;
+uniform float min_length;
+// world space planes of the view frusta, six per view pointing inwards
+uniform vec4 frustum_planes[24];
+uniform vec3 viewer_pos[4];
+uniform uint num_views;
+uniform vec3[5] sensor_pos;
+uniform uint cull_backfaces;
+// allowance for the curvature of the calibration mapping between tile corners
+const float tile_margin = 0.02f;
+
+// one tile per workgroup, depths are stored as bits, which order like the non-negative floats
+shared uint tile_depth_min;
+shared uint tile_depth_max;
+shared bool tile_visible;
+shared bool tile_front;
+
+// same criteria as the former geometry shader
+bool valid_surface(const in vec3 pos_a, const in vec3 pos_b, const in vec3 pos_c,
+                   const in float depth_a, const in float depth_b, const in float depth_c) {
+  // discard if invalid depth is contained
+  if (depth_a < 0.0f || depth_b < 0.0f || depth_c < 0.0f) {
+    return false;
+  }
+  float avg_depth = (depth_a + depth_b + depth_c) / 3.0f;
+  float l = min_length * avg_depth * 4.0f;
+  // all position differences must be smaller than l
+  return length(pos_b - pos_a) < l && length(pos_c - pos_a) < l && length(pos_c - pos_b) < l;
+}
+
+void write_vertex(const in uint layer, const in uint vertex, const in vec2 coords, const in vec3 position, const in float depth) {
+  vec2 texcoord = sample_uv(layer, vec3(coords, depth));
+  float quality = texture(kinect_qualities, vec3(coords, float(layer))).r;
+  Vertex v = Vertex(vec4(position, depth), vec4(texcoord, quality, 0.0f));
+  vertex_data[layer * res_depth.x * res_depth.y + vertex] = v;
+}
+
+void emit_triangle(const in uint layer, const in uint a, const in uint b, const in uint c) {
+  uint offset = commands[layer].first_index + atomicAdd(commands[layer].count, 3u);
+  indices[offset] = a;
+  indices[offset + 1u] = b;
+  indices[offset + 2u] = c;
+}
+
+bool box_in_frustum(const in uint view, const in vec3 box_min, const in vec3 box_max) {
+  for (uint i = view * 6u; i < view * 6u + 6u; ++i) {
+    // corner furthest along the plane normal
+    vec3 corner = mix(box_min, box_max, greaterThanEqual(frustum_planes[i].xyz, vec3(0.0f)));
+    if (dot(frustum_planes[i].xyz, corner) + frustum_planes[i].w < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// bounds of the tile from its depth range through the calibration
+bool tile_in_frustum(const in uint layer, const in float depth_min, const in float depth_max) {
+  vec2 coords_min = (vec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy) + 0.5f) / vec2(res_depth);
+  vec2 coords_max = min((vec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy + gl_WorkGroupSize.xy) + 0.5f) / vec2(res_depth), vec2(1.0f));
+  vec3 box_min = vec3(1e30f);
+  vec3 box_max = vec3(-1e30f);
+  for (uint c = 0u; c < 8u; ++c) {
+    vec3 coords = vec3((c & 1u) != 0u ? coords_max.x : coords_min.x,
+                       (c & 2u) != 0u ? coords_max.y : coords_min.y,
+                       (c & 4u) != 0u ? depth_max : depth_min);
+    vec3 pos = sample_xyz(layer, coords);
+    box_min = min(box_min, pos);
+    box_max = max(box_max, pos);
+  }
+  // triangles are shared by all views
+  for (uint view = 0u; view < num_views; ++view) {
+    if (box_in_frustum(view, box_min - tile_margin, box_max + tile_margin)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool faces_viewer(const in uint layer, const in vec3 pos_a, const in vec3 pos_b, const in vec3 pos_c) {
+  // orient towards the sensor which observed the surface
+  vec3 normal = cross(pos_b - pos_a, pos_c - pos_a);
+  normal *= sign(dot(normal, sensor_pos[layer] - pos_a));
+  for (uint view = 0u; view < num_views; ++view) {
+    if (dot(normal, viewer_pos[view] - pos_a) > 0.0f) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void main() {
+  uint layer = gl_WorkGroupID.z;
+  uvec2 pixel = gl_GlobalInvocationID.xy;
+  // the last row and column have no neighbours to span a quad
+  bool inside = all(lessThan(pixel + 1u, res_depth));
+  if (gl_LocalInvocationIndex == 0u) {
+    tile_depth_min = floatBitsToUint(1e30f);
+    tile_depth_max = 0u;
+    tile_front = cull_backfaces == 0u;
+  }
+  barrier();
+
+  float depths[4];
+  uint vertices[4];
+  vec2 coords[4];
+  for (uint c = 0u; c < 4u; ++c) {
+    uvec2 corner = min(pixel + uvec2(c & 1u, c >> 1u), res_depth - 1u);
+    coords[c] = (vec2(corner) + 0.5f) / vec2(res_depth);
+    depths[c] = texture(kinect_depths, vec3(coords[c], float(layer))).r;
+    vertices[c] = corner.y * res_depth.x + corner.x;
+    if (inside && depths[c] >= 0.0f) {
+      atomicMin(tile_depth_min, floatBitsToUint(depths[c]));
+      atomicMax(tile_depth_max, floatBitsToUint(depths[c]));
+    }
+  }
+  barrier();
+  if (gl_LocalInvocationIndex == 0u) {
+    // tiles without valid depth produce no triangles either
+    tile_visible = tile_depth_max > 0u
+                && tile_in_frustum(layer, uintBitsToFloat(tile_depth_min), uintBitsToFloat(tile_depth_max));
+  }
+  barrier();
+  // uniform in the workgroup, keeps the barrier below in uniform control flow
+  if (tile_visible) {
+    vec3 positions[4];
+    for (uint c = 0u; c < 4u; ++c) {
+      positions[c] = sample_xyz(layer, vec3(coords[c], depths[c]));
+    }
+    // own pixel, the last row and column also write the corners in the next tiles
+    uvec2 last = gl_WorkGroupSize.xy - 1u;
+    for (uint c = 0u; c < 4u; ++c) {
+      uvec2 offset = uvec2(c & 1u, c >> 1u);
+      if (all(lessThanEqual(offset, uvec2(equal(gl_LocalInvocationID.xy, last)))) && all(lessThan(pixel, res_depth))) {
+        write_vertex(layer, vertices[c], coords[c], positions[c], depths[c]);
+      }
+    }
+    // same split and winding as the triangle grid
+    bool valid_0 = inside && valid_surface(positions[0], positions[1], positions[2], depths[0], depths[1], depths[2]);
+    bool valid_1 = inside && valid_surface(positions[1], positions[3], positions[2], depths[1], depths[3], depths[2]);
+    if (cull_backfaces > 0u) {
+      if ((valid_0 && faces_viewer(layer, positions[0], positions[1], positions[2]))
+       || (valid_1 && faces_viewer(layer, positions[1], positions[3], positions[2]))) {
+        tile_front = true;
+      }
+      barrier();
+    }
+    // tiles seen only from behind are skipped as a whole
+    if (tile_front && valid_0) {
+      emit_triangle(layer, vertices[0], vertices[1], vertices[2]);
+    }
+    if (tile_front && valid_1) {
+      emit_triangle(layer, vertices[1], vertices[3], vertices[2]);
+    }
+  }
+}
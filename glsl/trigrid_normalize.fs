@@ -7,10 +7,11 @@ uniform sampler2DArray depth_map;
 
 uniform vec2 texSizeInv;
 uniform vec2 offset;
+uniform float layer;
 
 void main(){
 
-  vec3 coords = vec3((gl_FragCoord.xy - offset) * texSizeInv, 0.0 /*here layer is always 0*/);
+  vec3 coords = vec3((gl_FragCoord.xy - offset) * texSizeInv, layer);
 
   bool bg = false;
   vec4 final_col = vec4(0.0);
@@ -0,0 +1,178 @@
+#version 430
+#extension GL_ARB_shading_language_include : require
+// one workgroup integrates one brick of 8^3 voxels
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+
+// input
+uniform sampler2DArray kinect_colors;
+uniform sampler2DArray kinect_depths;
+uniform sampler2DArray kinect_qualities;
+uniform sampler2DArray kinect_normals;
+// calibration
+uniform sampler3D[5] cv_xyz_inv;
+#include "/calib_decode.glsl"
+// bit i set if camera i sees the voxel
+uniform usampler3D cv_valid;
+
+layout(r32f) uniform image3D volume_tsdf;
+// accumulated observation weight, only used with temporal fusion
+layout(r32f) uniform image3D volume_weight;
+// blended color and normal of the current frame, replace per pixel blending when raymarching
+layout(rgba8) uniform writeonly image3D volume_color;
+layout(rgba8_snorm) uniform writeonly image3D volume_normal;
+uniform uint write_shading;
+// off when a pass only refreshes the shading volumes
+uniform uint write_tsdf;
+// bricks seen by at least one camera
+layout(std430, binding = 2) buffer BrickBuffer {
+  uint bricks[];
+};
+
+uniform float limit;
+uniform uint num_kinects;
+uniform uint num_bricks;
+uniform uvec3 res_tsdf;
+// box of a nested level inside the base volume, calibration is looked up in base volume space
+uniform vec3 level_min;
+uniform vec3 level_size;
+uniform uvec3 res_inv;
+// inverse volume footprint of a brick fits into the cache
+uniform uint cache_inv;
+// sparse volumes store the brick of workgroup i at slot i of the pool atlas
+uniform uint sparse;
+uniform uint pool_res;
+// fuse with previous frames instead of overwriting
+uniform uint temporal;
+uniform float max_weight;
+uniform float motion_threshold;
+uniform float motion_decay;
+
+// running weighted average over frames, history fades quickly where the surface moved
+vec2 fuse_temporal(const in ivec3 voxel, const in float tsd, const in float weight) {
+  float tsd_old = imageLoad(volume_tsdf, voxel).r;
+  float weight_old = imageLoad(volume_weight, voxel).r;
+  if (abs(tsd - tsd_old) > motion_threshold) {
+    weight_old *= motion_decay;
+  }
+  float tsd_fused = (tsd_old * weight_old + tsd * weight) / (weight_old + weight);
+  return vec2(tsd_fused, min(weight_old + weight, max_weight));
+}
+
+// footprint of one brick in the inverse volume, at most 10^3 texels
+shared vec3 inv_cache[1000];
+shared uint brick_cameras;
+
+// trilinear lookup into the cached footprint, same as texture filtering
+vec3 sample_cache(const in vec3 pos_vol, const in ivec3 origin, const in ivec3 extent) {
+  vec3 pos = clamp(pos_vol * vec3(res_inv) - 0.5f, vec3(0.0f), vec3(res_inv - 1u));
+  ivec3 p0 = ivec3(floor(pos));
+  ivec3 p1 = min(p0 + 1, ivec3(res_inv) - 1);
+  vec3 t = pos - vec3(p0);
+  p0 -= origin;
+  p1 -= origin;
+  vec3 c00 = mix(inv_cache[(p0.z * extent.y + p0.y) * extent.x + p0.x], inv_cache[(p0.z * extent.y + p0.y) * extent.x + p1.x], t.x);
+  vec3 c10 = mix(inv_cache[(p0.z * extent.y + p1.y) * extent.x + p0.x], inv_cache[(p0.z * extent.y + p1.y) * extent.x + p1.x], t.x);
+  vec3 c01 = mix(inv_cache[(p1.z * extent.y + p0.y) * extent.x + p0.x], inv_cache[(p1.z * extent.y + p0.y) * extent.x + p1.x], t.x);
+  vec3 c11 = mix(inv_cache[(p1.z * extent.y + p1.y) * extent.x + p0.x], inv_cache[(p1.z * extent.y + p1.y) * extent.x + p1.x], t.x);
+  return mix(mix(c00, c10, t.y), mix(c01, c11, t.y), t.z);
+}
+
+void main() {
+  // large dispatches are split over two dimensions
+  uint brick_id = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+  if (brick_id >= num_bricks) {
+    return;
+  }
+  uvec3 res_bricks = (res_tsdf + 7u) / 8u;
+  uint brick = bricks[brick_id];
+  // pool slot freed by the eviction
+  if (brick == 0xFFFFFFFFu) {
+    return;
+  }
+  uvec3 brick_pos = uvec3(brick % res_bricks.x, (brick / res_bricks.x) % res_bricks.y, brick / (res_bricks.x * res_bricks.y));
+  uvec3 voxel = brick_pos * 8u + gl_LocalInvocationID;
+  bool inside = all(lessThan(voxel, res_tsdf));
+  vec3 pos_vol = level_min + level_size * (vec3(voxel) + 0.5f) / vec3(res_tsdf);
+
+  uint valid = inside ? texture(cv_valid, pos_vol).r : 0u;
+  if (gl_LocalInvocationIndex == 0u) {
+    brick_cameras = 0u;
+  }
+  barrier();
+  atomicOr(brick_cameras, valid);
+  barrier();
+
+  vec3 brick_min = level_min + level_size * vec3(brick_pos * 8u) / vec3(res_tsdf);
+  vec3 brick_max = level_min + level_size * vec3(min(brick_pos * 8u + 8u, res_tsdf)) / vec3(res_tsdf);
+  ivec3 origin = clamp(ivec3(floor(brick_min * vec3(res_inv) - 0.5f)), ivec3(0), ivec3(res_inv) - 1);
+  ivec3 extent = clamp(ivec3(floor(brick_max * vec3(res_inv) - 0.5f)) + 1, ivec3(0), ivec3(res_inv) - 1) - origin + 1;
+  uint num_texels = uint(extent.x * extent.y * extent.z);
+
+  float weighted_tsd = limit;
+  float weight = 0;
+  // quality of the cameras seeing the voxel in front of their surface
+  float weight_free = 0.0f;
+  vec3 color = vec3(0.0f);
+  vec3 normal = vec3(0.0f);
+  for (uint i = 0u; i < num_kinects; ++i) {
+    // uniform in the workgroup, keeps barriers in uniform control flow
+    if ((brick_cameras & (1u << i)) == 0u) {
+      continue;
+    }
+    if (cache_inv > 0u) {
+      barrier();
+      for (uint t = gl_LocalInvocationIndex; t < num_texels; t += 512u) {
+        ivec3 texel = ivec3(t % extent.x, (t / extent.x) % extent.y, t / (extent.x * extent.y));
+        inv_cache[t] = texelFetch(cv_xyz_inv[i], origin + texel, 0).xyz;
+      }
+      barrier();
+    }
+    if ((valid & (1u << i)) == 0u) {
+      continue;
+    }
+    vec3 pos_calib = cache_inv > 0u ? sample_cache(pos_vol, origin, extent) : texture(cv_xyz_inv[i], pos_vol).xyz;
+    float depth = texture(kinect_depths, vec3(pos_calib.xy, float(i))).r;
+    float sdist = depth - pos_calib.z;
+    if (sdist > -limit && sdist < limit) {
+      float tsd = clamp(sdist, -limit, limit);
+      float lateral_quality = texture(kinect_qualities, vec3(pos_calib.xy, float(i))).r;
+      float quality = lateral_quality/(pos_calib.z * 4.0f + 0.5f);
+      weighted_tsd = (weighted_tsd * weight + quality * tsd) / (weight + quality);
+      weight += quality;
+      if (write_shading > 0u) {
+        vec2 pos_color = sample_uv(i, pos_calib);
+        color += texture(kinect_colors, vec3(pos_color, float(i))).rgb * quality;
+        normal += texture(kinect_normals, vec3(pos_calib.xy, float(i))).rgb * quality;
+      }
+    }
+    else if (temporal > 0u && sdist >= limit) {
+      weight_free += texture(kinect_qualities, vec3(pos_calib.xy, float(i))).r / (pos_calib.z * 4.0f + 0.5f);
+    }
+  }
+
+  if (inside) {
+    ivec3 texel = ivec3(voxel);
+    if (sparse > 0u) {
+      uvec3 slot = uvec3(brick_id % pool_res, (brick_id / pool_res) % pool_res, brick_id / (pool_res * pool_res));
+      texel = ivec3(slot * 8u + gl_LocalInvocationID);
+    }
+    if (write_shading > 0u && weight > 0.0f) {
+      imageStore(volume_color, texel, vec4(color / weight, 1.0f));
+      imageStore(volume_normal, texel, vec4(normal / weight, 0.0f));
+    }
+    if (write_tsdf == 0u) {
+      return;
+    }
+    if (temporal > 0u) {
+      // free space observations fade old surfaces, unobserved and occluded voxels keep their history
+      float weight_frame = weight > 0.0f ? weight : weight_free;
+      if (weight_frame <= 0.0f) {
+        return;
+      }
+      vec2 fused = fuse_temporal(texel, weighted_tsd, weight_frame);
+      weighted_tsd = fused.x;
+      imageStore(volume_weight, texel, vec4(fused.y, 0.0f, 0.0f, 0.0f));
+    }
+    imageStore(volume_tsdf, texel, vec4(weighted_tsd, 0.0f, 0.0f, 0.0f));
+  }
+}
@@ -1,29 +1,72 @@
 #version 430
+#extension GL_ARB_shading_language_include : require
 
-in vec3 in_Position; 
 // input
 uniform sampler2DArray kinect_colors;
 uniform sampler2DArray kinect_depths;
 uniform sampler2DArray kinect_qualities;
+uniform sampler2DArray kinect_normals;
 // calibration
 uniform sampler3D[5] cv_xyz_inv;
+#include "/calib_decode.glsl"
+// bit i set if camera i sees the voxel
+uniform usampler3D cv_valid;
 
 layout(r32f) uniform image3D volume_tsdf;
+// accumulated observation weight, only used with temporal fusion
+layout(r32f) uniform image3D volume_weight;
+// blended color and normal of the current frame, replace per pixel blending when raymarching
+layout(rgba8) uniform writeonly image3D volume_color;
+layout(rgba8_snorm) uniform writeonly image3D volume_normal;
+uniform uint write_shading;
+// off when a pass only refreshes the shading volumes
+uniform uint write_tsdf;
 
 uniform float limit;
 uniform uint num_kinects;
 uniform uvec3 res_tsdf;
 uniform uvec2 res_depth;
+// fuse with previous frames instead of overwriting
+uniform uint temporal;
+uniform float max_weight;
+uniform float motion_threshold;
+uniform float motion_decay;
+
+// running weighted average over frames, history fades quickly where the surface moved
+vec2 fuse_temporal(const in ivec3 voxel, const in float tsd, const in float weight) {
+  float tsd_old = imageLoad(volume_tsdf, voxel).r;
+  float weight_old = imageLoad(volume_weight, voxel).r;
+  if (abs(tsd - tsd_old) > motion_threshold) {
+    weight_old *= motion_decay;
+  }
+  float tsd_fused = (tsd_old * weight_old + tsd * weight) / (weight_old + weight);
+  return vec2(tsd_fused, min(weight_old + weight, max_weight));
+}
+
+// voxel of this invocation, x varies fastest
+uvec3 voxel_index(const in uint index, const in uvec3 res) {
+  return uvec3(index % res.x, (index / res.x) % res.y, index / (res.x * res.y));
+}
 
 bool is_outside(float depth) {
   return depth < 0.0f || depth > 1.0f;
 }
 
 void main() {
+  uvec3 voxel = voxel_index(uint(gl_VertexID), res_tsdf);
+  vec3 pos_vol = (vec3(voxel) + 0.5f) / vec3(res_tsdf);
   float weighted_tsd = limit;
   float weight = 0;
+  // quality of the cameras seeing the voxel in front of their surface
+  float weight_free = 0.0f;
+  vec3 color = vec3(0.0f);
+  vec3 normal = vec3(0.0f);
+  uint valid = texture(cv_valid, pos_vol).r;
   for (uint i = 0u; i < num_kinects; ++i) {
-    vec3 pos_calib = texture(cv_xyz_inv[i], in_Position).xyz;
+    if ((valid & (1u << i)) == 0u) {
+      continue;
+    }
+    vec3 pos_calib = texture(cv_xyz_inv[i], pos_vol).xyz;
     float depth = texture(kinect_depths, vec3(pos_calib.xy, float(i))).r;
     // if (is_outside(depth)) {
     //   // no write yet -> voxel outside of surface
@@ -41,7 +84,9 @@ void main() {
       // break;
     }
     else if (sdist >= limit ) {
-      // do nothing
+      if (temporal > 0u) {
+        weight_free += texture(kinect_qualities, vec3(pos_calib.xy, float(i))).r / (pos_calib.z * 4.0f + 0.5f);
+      }
     }
     else {
       float tsd = clamp(sdist, -limit, limit);
@@ -49,10 +94,30 @@ void main() {
       float quality = lateral_quality/(pos_calib.z * 4.0f + 0.5f);
       weighted_tsd = (weighted_tsd * weight + quality * tsd) / (weight + quality);
       weight += quality;
+      if (write_shading > 0u) {
+        vec2 pos_color = sample_uv(i, pos_calib);
+        color += texture(kinect_colors, vec3(pos_color, float(i))).rgb * quality;
+        normal += texture(kinect_normals, vec3(pos_calib.xy, float(i))).rgb * quality;
+      }
     }
   }
 
-  // coordinates must be even pixels
-  ivec3 ipos_vol = ivec3(round(in_Position * res_tsdf - vec3(0.5f)));
-  imageStore(volume_tsdf, ipos_vol, vec4(weighted_tsd, 0.0f, 0.0f, 0.0f));
+  if (write_shading > 0u && weight > 0.0f) {
+    imageStore(volume_color, ivec3(voxel), vec4(color / weight, 1.0f));
+    imageStore(volume_normal, ivec3(voxel), vec4(normal / weight, 0.0f));
+  }
+  if (write_tsdf == 0u) {
+    return;
+  }
+  if (temporal > 0u) {
+    // free space observations fade old surfaces, unobserved and occluded voxels keep their history
+    float weight_frame = weight > 0.0f ? weight : weight_free;
+    if (weight_frame <= 0.0f) {
+      return;
+    }
+    vec2 fused = fuse_temporal(ivec3(voxel), weighted_tsd, weight_frame);
+    weighted_tsd = fused.x;
+    imageStore(volume_weight, ivec3(voxel), vec4(fused.y, 0.0f, 0.0f, 0.0f));
+  }
+  imageStore(volume_tsdf, ivec3(voxel), vec4(weighted_tsd, 0.0f, 0.0f, 0.0f));
 }
\ No newline at end of file
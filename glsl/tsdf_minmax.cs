@@ -0,0 +1,61 @@
+#version 430
+// level 0: one workgroup reduces one brick, higher levels: one invocation per node
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+
+uniform sampler3D volume_tsdf;
+layout(rg32f) uniform image3D minmax_src;
+layout(rg32f) uniform image3D minmax_dst;
+
+uniform uint level;
+uniform uvec3 res_tsdf;
+uniform float limit;
+
+shared vec2 min_max[512];
+
+vec2 reduce_brick(const in uvec3 brick) {
+  // trilinear samples inside the brick also read the neighbouring voxels
+  ivec3 origin = ivec3(brick * 8u) - 1;
+  vec2 local_min_max = vec2(limit, -limit);
+  for (uint t = gl_LocalInvocationIndex; t < 1000u; t += 512u) {
+    ivec3 voxel = clamp(origin + ivec3(t % 10u, (t / 10u) % 10u, t / 100u), ivec3(0), ivec3(res_tsdf) - 1);
+    float tsd = texelFetch(volume_tsdf, voxel, 0).r;
+    local_min_max = vec2(min(local_min_max.x, tsd), max(local_min_max.y, tsd));
+  }
+  min_max[gl_LocalInvocationIndex] = local_min_max;
+  barrier();
+  for (uint stride = 256u; stride > 0u; stride /= 2u) {
+    if (gl_LocalInvocationIndex < stride) {
+      vec2 other = min_max[gl_LocalInvocationIndex + stride];
+      min_max[gl_LocalInvocationIndex] = vec2(min(min_max[gl_LocalInvocationIndex].x, other.x), max(min_max[gl_LocalInvocationIndex].y, other.y));
+    }
+    barrier();
+  }
+  return min_max[0];
+}
+
+void main() {
+  if (level == 0u) {
+    uvec3 brick = gl_WorkGroupID;
+    // padding bricks of the power of two pyramid are empty
+    vec2 value = vec2(limit);
+    if (all(lessThan(brick * 8u, res_tsdf))) {
+      value = reduce_brick(brick);
+    }
+    if (gl_LocalInvocationIndex == 0u) {
+      imageStore(minmax_dst, ivec3(brick), vec4(value, 0.0f, 0.0f));
+    }
+    return;
+  }
+  ivec3 node = ivec3(gl_GlobalInvocationID);
+  if (any(greaterThanEqual(node, imageSize(minmax_dst)))) {
+    return;
+  }
+  ivec3 res_src = imageSize(minmax_src);
+  vec2 value = vec2(limit, -limit);
+  for (uint c = 0u; c < 8u; ++c) {
+    ivec3 child = min(node * 2 + ivec3(c & 1u, (c >> 1u) & 1u, (c >> 2u) & 1u), res_src - 1);
+    vec2 child_value = imageLoad(minmax_src, child).rg;
+    value = vec2(min(value.x, child_value.x), max(value.y, child_value.y));
+  }
+  imageStore(minmax_dst, node, vec4(value, 0.0f, 0.0f));
+}
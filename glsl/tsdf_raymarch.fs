@@ -1,4 +1,7 @@
 #version 330
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shader_image_load_store : require
+#extension GL_ARB_shading_language_include : require
 
 in vec3 pass_Position;
 // input
@@ -8,7 +11,7 @@ uniform sampler2DArray kinect_qualities;
 uniform sampler2DArray kinect_normals;
 // calibration
 uniform sampler3D[5] cv_xyz_inv;
-uniform sampler3D[5] cv_uv;
+#include "/calib_decode.glsl"
 uniform uint num_kinects;
 uniform float limit;
 
@@ -18,6 +21,42 @@ uniform mat4 gl_ProjectionMatrix;
 uniform mat4 vol_to_world;
 
 uniform sampler3D volume_tsdf;
+// sparse volumes keep bricks in a pool atlas, found through a hash of the brick index
+layout(std430, binding = 3) buffer HashTable {
+  uint hash_table[];
+};
+uniform uint sparse;
+uniform uvec3 res_tsdf;
+uniform uint pool_res;
+uniform uint hash_size;
+// min and max tsd per brick with mips, nodes without sign change are skipped
+uniform sampler3D volume_minmax;
+uniform uint skip_empty;
+uniform uint levels_minmax;
+// number of rays and samples of a frame
+layout(std430, binding = 6) buffer RaymarchStats {
+  uint num_rays;
+  uint num_samples;
+};
+uniform uint collect_stats;
+// samples per pixel of the last frame
+layout(r32ui) uniform uimage2D step_counts;
+uniform uint write_steps;
+// step by the truncated distance and bisect the crossing
+uniform uint adaptive_steps;
+// metres per unit of normalized depth, smallest over the cameras
+uniform float depth_range;
+// color and normal blended during integration, one fetch instead of blending per pixel
+uniform sampler3D volume_color;
+uniform sampler3D volume_normal;
+uniform uint precomputed_shading;
+// finer levels nested in the base volume, boxes in base volume space
+uniform sampler3D[3] volume_nested;
+uniform vec3[3] nested_min;
+uniform vec3[3] nested_size;
+uniform uvec3[3] nested_res;
+uniform uint num_nested;
+const uint bisection_steps = 5u;
 uniform vec3 CameraPos;
 uniform vec3 Dimensions;
 
@@ -47,30 +86,63 @@ bool isInside(const vec3 pos);
 float sample(const vec3 pos);
 vec3 blendColors(const in vec3 sample_pos);
 vec3 blendNormals(const in vec3 sample_pos);
+ivec3 brick_at(const vec3 pos);
+float empty_distance(const vec3 pos, const vec3 dir);
+float nested_distance(const vec3 pos, const vec3 dir);
+void count_samples(const uint samples);
+vec3 bisect(vec3 pos_out, float density_out, vec3 pos_in, float density_in, inout uint samples);
 
 void main() {
   // multiply with dimensions to scale direction by dimension relation
-  vec3 sampleStep = normalize(pass_Position - CameraPos) * sampleDistance;
+  vec3 ray_dir = normalize(pass_Position - CameraPos);
+  vec3 sampleStep = ray_dir * sampleDistance;
+  // metric length of a unit of volume space along the ray
+  float metric_scale = length(Dimensions * ray_dir);
+  vec3 last_step = sampleStep;
 
   vec3 sample_pos = pass_Position;
   bool inside = isInside(sample_pos);  
   // cache value of previous sample
   float prev_density = sample(sample_pos); 
+  uint samples = 1u;
+  ivec3 occupied_brick = ivec3(-1);
 
   while (inside) {
+    // query the pyramid once per brick the ray enters
+    if (skip_empty > 0u && brick_at(sample_pos) != occupied_brick) {
+      // the pyramid only covers the base level
+      float steps = min(empty_distance(sample_pos, sampleStep), nested_distance(sample_pos, sampleStep));
+      if (steps > 0.0f) {
+        // stay on the step grid, previous sample lies inside the empty node
+        sample_pos += sampleStep * ceil(steps);
+        prev_density = sample(sample_pos - sampleStep);
+        last_step = sampleStep;
+        samples += 1u;
+        inside = isInside(sample_pos);
+        continue;
+      }
+      occupied_brick = brick_at(sample_pos);
+    }
      // get sample
     float density = sample(sample_pos);
+    samples += 1u;
 
     // check if cell is inside contour
     if (density < IsoValue && prev_density >= IsoValue) {
-      // approximate ray-cell intersection
-      sample_pos = (sample_pos - sampleStep) - sampleStep * (prev_density / (density - prev_density));
+      if (adaptive_steps > 0u) {
+        sample_pos = bisect(sample_pos - last_step, prev_density, sample_pos, density, samples);
+      }
+      else {
+        // approximate ray-cell intersection
+        sample_pos = (sample_pos - sampleStep) - sampleStep * (prev_density / (density - prev_density));
+      }
 
       float final_density = sample(sample_pos);
       #ifdef GRAD_NORMALS
       vec3 view_normal = normalize((NormalMatrix * vec4(get_gradient(sample_pos), 0.0f)).xyz);
       #else
-      vec3 view_normal = normalize((NormalMatrix * vec4(blendNormals(sample_pos), 0.0f)).xyz);
+      vec3 normal = precomputed_shading > 0u ? texture(volume_normal, sample_pos).rgb : blendNormals(sample_pos);
+      vec3 view_normal = normalize((NormalMatrix * vec4(normal, 0.0f)).xyz);
       #endif
       vec3 view_pos = (gl_ModelViewMatrix * vol_to_world * vec4(sample_pos, 1.0f)).xyz;
 
@@ -84,30 +156,186 @@ void main() {
         #ifdef NORMAL
           out_Color = vec4((inverse(gl_ModelViewMatrix) * vec4(view_normal, 0.0f)).xyz, 1.0f);
         #else
-          vec3 diffuseColor = blendColors(sample_pos);
+          vec3 diffuseColor = precomputed_shading > 0u ? texture(volume_color, sample_pos).rgb : blendColors(sample_pos);
           out_Color = vec4(diffuseColor, 1.0f);
         #endif
       #endif
       // apply projection matrix on z component of view-space position
       gl_FragDepth = (gl_ProjectionMatrix[2].z *view_pos.z + gl_ProjectionMatrix[3].z) / -view_pos.z * 0.5f + 0.5f;
+      count_samples(samples);
       return;
     }
 
     prev_density = density;
-    sample_pos += sampleStep;
+    last_step = sampleStep;
+    if (adaptive_steps > 0u) {
+      // sphere tracing, the surface is at least the tsd away, the minimum keeps rays moving at the crossing
+      // saturated samples may overshoot by less than the band behind the surface, they still land in it
+      float tsd_step = density >= limit ? density + limit * 0.9f : max(density, limit * 0.1f);
+      // tsd is in normalized sensor depth
+      last_step = ray_dir * (tsd_step * depth_range / metric_scale);
+    }
+    sample_pos += last_step;
     inside = isInside(sample_pos); 
   }
   // no surface found 
+  count_samples(samples);
   discard;
 }
 
+ivec3 brick_at(const vec3 pos) {
+  return ivec3(clamp(pos * vec3(res_tsdf), vec3(0.0f), vec3(res_tsdf) - 0.5f) / 8.0f);
+}
+
+// distance in units of dir to the exit of the largest empty node containing pos, 0 if occupied
+float empty_distance(const vec3 pos, const vec3 dir) {
+  uvec3 brick = uvec3(brick_at(pos));
+  for (int level = int(levels_minmax) - 1; level >= 0; --level) {
+    uvec3 node = brick >> uint(level);
+    vec2 min_max = texelFetch(volume_minmax, ivec3(node), level).rg;
+    if (min_max.x > IsoValue || min_max.y < IsoValue) {
+      vec3 node_size = vec3(float(8u << uint(level))) / vec3(res_tsdf);
+      vec3 node_min = vec3(node) * node_size;
+      vec3 t_exit = max((node_min - pos) / dir, (node_min + node_size - pos) / dir);
+      return min(t_exit.x, min(t_exit.y, t_exit.z));
+    }
+  }
+  return 0.0f;
+}
+
+// distance in units of dir to the entry of the outermost nested level, 0 inside and infinite if missed
+float nested_distance(const vec3 pos, const vec3 dir) {
+  if (num_nested == 0u) {
+    return 1e30f;
+  }
+  vec3 t_min = (nested_min[0] - pos) / dir;
+  vec3 t_max = (nested_min[0] + nested_size[0] - pos) / dir;
+  vec3 t_near = min(t_min, t_max);
+  vec3 t_far = max(t_min, t_max);
+  float t_enter = max(t_near.x, max(t_near.y, t_near.z));
+  float t_exit = min(t_far.x, min(t_far.y, t_far.z));
+  if (t_exit < max(t_enter, 0.0f)) {
+    return 1e30f;
+  }
+  return max(t_enter, 0.0f);
+}
+
+void count_samples(const uint samples) {
+  if (collect_stats > 0u) {
+    atomicAdd(num_rays, 1u);
+    atomicAdd(num_samples, samples);
+  }
+  if (write_steps > 0u) {
+    imageStore(step_counts, ivec2(gl_FragCoord.xy), uvec4(samples));
+  }
+}
+
+// refine the crossing between a sample outside and one inside the surface
+vec3 bisect(vec3 pos_out, float density_out, vec3 pos_in, float density_in, inout uint samples) {
+  for (uint i = 0u; i < bisection_steps; ++i) {
+    vec3 pos_mid = (pos_out + pos_in) * 0.5f;
+    float density_mid = sample(pos_mid);
+    samples += 1u;
+    if (density_mid < IsoValue) {
+      pos_in = pos_mid;
+      density_in = density_mid;
+    }
+    else {
+      pos_out = pos_mid;
+      density_out = density_mid;
+    }
+  }
+  return pos_out + (pos_in - pos_out) * (density_out / (density_out - density_in));
+}
+
 bool isInside(const vec3 pos) {
   return pos.x >= 0.0f && pos.x <= 1.0f
       && pos.y >= 0.0f && pos.y <= 1.0f
       && pos.z >= 0.0f && pos.z <= 1.0f;
 }
 
+const uint invalid_slot = 0xFFFFFFFFu;
+
+uint lookup_slot(const in uvec3 brick_pos) {
+  uvec3 res_bricks = (res_tsdf + 7u) / 8u;
+  uint brick = (brick_pos.z * res_bricks.y + brick_pos.y) * res_bricks.x + brick_pos.x;
+  uint entry = (brick * 2654435761u) & (hash_size - 1u);
+  // entries are never removed, an empty one ends the probe sequence
+  for (uint probe = 0u; probe < hash_size; ++probe) {
+    uint key = hash_table[entry * 2u];
+    if (key == brick + 1u) {
+      return hash_table[entry * 2u + 1u];
+    }
+    if (key == 0u) {
+      break;
+    }
+    entry = (entry + 1u) & (hash_size - 1u);
+  }
+  return invalid_slot;
+}
+
+uvec3 slot_origin(const in uint slot) {
+  return uvec3(slot % pool_res, (slot / pool_res) % pool_res, slot / (pool_res * pool_res)) * 8u;
+}
+
+float sample_sparse(const vec3 pos) {
+  vec3 pos_voxel = clamp(pos * vec3(res_tsdf) - 0.5f, vec3(0.0f), vec3(res_tsdf - 1u));
+  uvec3 v0 = uvec3(pos_voxel);
+  uvec3 v1 = min(v0 + 1u, res_tsdf - 1u);
+  // unallocated bricks are empty space
+  if (all(equal(v0 / 8u, v1 / 8u))) {
+    // all filter taps in one brick, hardware filtering is valid
+    uint slot = lookup_slot(v0 / 8u);
+    if (slot == invalid_slot) {
+      return limit;
+    }
+    vec3 pos_atlas = vec3(slot_origin(slot)) + pos_voxel - vec3((v0 / 8u) * 8u) + 0.5f;
+    return texture(volume_tsdf, pos_atlas / vec3(pool_res * 8u)).r;
+  }
+  float values[8];
+  for (uint c = 0u; c < 8u; ++c) {
+    uvec3 v = uvec3((c & 1u) != 0u ? v1.x : v0.x, (c & 2u) != 0u ? v1.y : v0.y, (c & 4u) != 0u ? v1.z : v0.z);
+    uint slot = lookup_slot(v / 8u);
+    values[c] = slot == invalid_slot ? limit : texelFetch(volume_tsdf, ivec3(slot_origin(slot) + v % 8u), 0).r;
+  }
+  vec3 t = pos_voxel - vec3(v0);
+  vec4 x = mix(vec4(values[0], values[2], values[4], values[6]), vec4(values[1], values[3], values[5], values[7]), t.x);
+  vec2 y = mix(x.xz, x.yw, t.y);
+  return mix(y.x, y.y, t.z);
+}
+
+float sample_level(const int level, const vec3 pos) {
+  if (level < 0) {
+    return texture(volume_tsdf, pos).r;
+  }
+  return texture(volume_nested[level], (pos - nested_min[level]) / nested_size[level]).r;
+}
+
+// finest level containing pos, faded into its parent over the outer two voxels
+float sample_nested(const vec3 pos) {
+  for (int level = int(num_nested) - 1; level >= 0; --level) {
+    vec3 pos_level = (pos - nested_min[level]) / nested_size[level];
+    if (any(lessThan(pos_level, vec3(0.0f))) || any(greaterThan(pos_level, vec3(1.0f)))) {
+      continue;
+    }
+    float value = texture(volume_nested[level], pos_level).r;
+    vec3 border = min(pos_level, 1.0f - pos_level) * vec3(nested_res[level]);
+    float blend = clamp(min(border.x, min(border.y, border.z)) * 0.5f, 0.0f, 1.0f);
+    if (blend < 1.0f) {
+      value = mix(sample_level(level - 1, pos), value, blend);
+    }
+    return value;
+  }
+  return texture(volume_tsdf, pos).r;
+}
+
 float sample(const vec3 pos) {
+  if (sparse > 0u) {
+    return sample_sparse(pos);
+  }
+  if (num_nested > 0u) {
+    return sample_nested(pos);
+  }
   return texture(volume_tsdf, pos).r;
 }
 
@@ -145,7 +373,7 @@ vec3 blendColors(const in vec3 sample_pos) {
   float[5] weights = getWeights(sample_pos);
   for(uint i = 0u; i < num_kinects; ++i) {
     vec3 pos_calib = texture(cv_xyz_inv[i], sample_pos).xyz;
-    vec2 pos_color = texture(cv_uv[i], pos_calib).xy;
+    vec2 pos_color = sample_uv(i, pos_calib);
     vec3 color = texture(kinect_colors, vec3(pos_color.xy, float(i))).rgb;
 
     total_color += color * weights[i];
@@ -0,0 +1,132 @@
+#version 430
+// one invocation tests one candidate brick and allocates a pool slot if a surface is near
+layout(local_size_x = 64) in;
+
+// input
+uniform sampler2DArray kinect_depths;
+// calibration
+uniform sampler3D[5] cv_xyz_inv;
+// bit i set if camera i sees the voxel
+uniform usampler3D cv_valid;
+
+// bricks inside any frustum
+layout(std430, binding = 5) buffer CandidateBuffer {
+  uint candidates[];
+};
+// key brick + 1 and pool slot per entry, zero key is empty
+layout(std430, binding = 3) buffer HashTable {
+  uint hash_table[];
+};
+// brick stored in each pool slot
+layout(std430, binding = 2) buffer BrickBuffer {
+  uint bricks[];
+};
+// doubles as indirect dispatch arguments of the integration
+layout(std430, binding = 4) buffer Allocation {
+  uint num_allocated;
+  uint num_groups_y;
+  uint num_groups_z;
+  int num_free;
+};
+// last frame each pool slot was near a surface
+layout(std430, binding = 13) buffer SlotAges {
+  uint last_seen[];
+};
+// slots released by the eviction, reused before growing the pool
+layout(std430, binding = 14) buffer FreeSlots {
+  uint free_slots[];
+};
+
+uniform uint num_kinects;
+uniform uint num_candidates;
+uniform uvec3 res_tsdf;
+uniform uint pool_size;
+uniform uint hash_size;
+uniform uint frame;
+// truncation limit plus half brick diagonal, in the normalized depth of each camera
+uniform float[5] band;
+
+const uint invalid_slot = 0xFFFFFFFFu;
+
+uint hash_brick(const in uint brick) {
+  return (brick * 2654435761u) & (hash_size - 1u);
+}
+
+uint pop_free_slot() {
+  int index = atomicAdd(num_free, -1) - 1;
+  if (index < 0) {
+    atomicAdd(num_free, 1);
+    return invalid_slot;
+  }
+  return free_slots[index];
+}
+
+bool near_surface(const in uvec3 brick_pos) {
+  vec3 brick_min = vec3(brick_pos * 8u) / vec3(res_tsdf);
+  vec3 brick_extent = vec3(8.0f) / vec3(res_tsdf);
+  for (uint i = 0u; i < num_kinects; ++i) {
+    // corners and center of the brick
+    for (uint c = 0u; c < 9u; ++c) {
+      vec3 corner = c < 8u ? vec3(c & 1u, (c >> 1u) & 1u, (c >> 2u) & 1u) : vec3(0.5f);
+      vec3 pos_vol = clamp(brick_min + corner * brick_extent, vec3(0.0f), vec3(1.0f));
+      if ((texture(cv_valid, pos_vol).r & (1u << i)) == 0u) {
+        continue;
+      }
+      vec3 pos_calib = texture(cv_xyz_inv[i], pos_vol).xyz;
+      float depth = texture(kinect_depths, vec3(pos_calib.xy, float(i))).r;
+      if (abs(depth - pos_calib.z) < band[i]) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void main() {
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= num_candidates) {
+    return;
+  }
+  uint brick = candidates[id];
+  uvec3 res_bricks = (res_tsdf + 7u) / 8u;
+  uvec3 brick_pos = uvec3(brick % res_bricks.x, (brick / res_bricks.x) % res_bricks.y, brick / (res_bricks.x * res_bricks.y));
+  if (!near_surface(brick_pos)) {
+    return;
+  }
+  // keep the table from filling up once the pool is exhausted
+  if (atomicAdd(num_allocated, 0u) >= pool_size && atomicAdd(num_free, 0) <= 0) {
+    return;
+  }
+
+  uint key = brick + 1u;
+  uint entry = hash_brick(brick);
+  for (uint probe = 0u; probe < hash_size; ++probe) {
+    uint prev = atomicCompSwap(hash_table[entry * 2u], 0u, key);
+    // allocated in a previous frame, candidates are unique so the slot is written
+    if (prev == key) {
+      uint slot = hash_table[entry * 2u + 1u];
+      if (slot != invalid_slot) {
+        last_seen[slot] = frame;
+      }
+      return;
+    }
+    if (prev == 0u) {
+      uint slot = pop_free_slot();
+      if (slot == invalid_slot) {
+        slot = atomicAdd(num_allocated, 1u);
+        if (slot >= pool_size) {
+          // undo the reservation, keeps the dispatch size at the pool size
+          atomicAdd(num_allocated, invalid_slot);
+          slot = invalid_slot;
+        }
+      }
+      if (slot != invalid_slot) {
+        bricks[slot] = brick;
+        last_seen[slot] = frame;
+      }
+      hash_table[entry * 2u + 1u] = slot;
+      return;
+    }
+    entry = (entry + 1u) & (hash_size - 1u);
+  }
+}
@@ -0,0 +1,79 @@
+#version 430
+// one workgroup per pool slot, frees bricks that were not near a surface for a while
+// the hash table is cleared before and rebuilt from the remaining slots
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+
+layout(r32f) uniform image3D volume_tsdf;
+layout(r32f) uniform image3D volume_weight;
+
+// key brick + 1 and pool slot per entry, zero key is empty
+layout(std430, binding = 3) buffer HashTable {
+  uint hash_table[];
+};
+// brick stored in each pool slot
+layout(std430, binding = 2) buffer BrickBuffer {
+  uint bricks[];
+};
+layout(std430, binding = 4) buffer Allocation {
+  uint num_allocated;
+  uint num_groups_y;
+  uint num_groups_z;
+  int num_free;
+};
+// last frame each pool slot was near a surface
+layout(std430, binding = 13) buffer SlotAges {
+  uint last_seen[];
+};
+// slots released by the eviction, reused before growing the pool
+layout(std430, binding = 14) buffer FreeSlots {
+  uint free_slots[];
+};
+
+uniform uint pool_res;
+uniform uint hash_size;
+uniform uint frame;
+uniform uint max_age;
+uniform float limit;
+
+const uint invalid_slot = 0xFFFFFFFFu;
+
+shared bool evict;
+
+uint hash_brick(const in uint brick) {
+  return (brick * 2654435761u) & (hash_size - 1u);
+}
+
+void insert(const in uint brick, const in uint slot) {
+  uint entry = hash_brick(brick);
+  for (uint probe = 0u; probe < hash_size; ++probe) {
+    if (atomicCompSwap(hash_table[entry * 2u], 0u, brick + 1u) == 0u) {
+      hash_table[entry * 2u + 1u] = slot;
+      return;
+    }
+    entry = (entry + 1u) & (hash_size - 1u);
+  }
+}
+
+void main() {
+  uint slot = gl_WorkGroupID.x;
+  if (gl_LocalInvocationIndex == 0u) {
+    uint brick = bricks[slot];
+    // freed slots stay invalid until the allocation reuses them
+    evict = brick != invalid_slot && frame - last_seen[slot] > max_age;
+    if (evict) {
+      bricks[slot] = invalid_slot;
+      free_slots[atomicAdd(num_free, 1)] = slot;
+    }
+    else if (brick != invalid_slot) {
+      insert(brick, slot);
+    }
+  }
+  barrier();
+  // the next brick in the slot starts without history
+  if (evict) {
+    uvec3 slot_pos = uvec3(slot % pool_res, (slot / pool_res) % pool_res, slot / (pool_res * pool_res));
+    ivec3 texel = ivec3(slot_pos * 8u + gl_LocalInvocationID);
+    imageStore(volume_tsdf, texel, vec4(limit, 0.0f, 0.0f, 0.0f));
+    imageStore(volume_weight, texel, vec4(0.0f));
+  }
+}
@@ -0,0 +1,78 @@
+#include "calibration_model.hpp"
+#include "calibration_volume.hpp"
+#include "DataTypes.h"
+#include "CMDParser.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// fits an analytic model to a volume and reports the deviation
+template<typename T>
+kinect::CalibrationModel fitVolume(std::string const& filename, glm::uvec3 const& grid_res, std::string const& unit) {
+  kinect::CalibrationVolume<T> volume{filename};
+  std::vector<float> values{volume.floats()};
+  unsigned channels = sizeof(T) / sizeof(float);
+  kinect::CalibrationModel model{values, channels, volume.res(), grid_res};
+  glm::fvec2 error_poly{model.error(values, volume.res(), false)};
+  glm::fvec2 error_model{model.error(values, volume.res(), true)};
+  #pragma omp critical
+  {
+    std::cout << filename << std::endl;
+    std::cout << "  polynomial - max error " << error_poly.x << unit << ", rms " << error_poly.y << unit << std::endl;
+    std::cout << "  with grid  - max error " << error_model.x << unit << ", rms " << error_model.y << unit << std::endl;
+    std::cout << "  size " << volume.numVoxels() * sizeof(T) / 1024 << " KB -> " << model.numBytes() / 1024 << " KB" << std::endl;
+  }
+  return model;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[]) {
+  CMDParser p("ks_file");
+  p.addOpt("g",3,"grid_resolution", "set resolution of the residual grid (default 16 16 16)");
+
+  p.init(argc,argv);
+
+  glm::uvec3 grid_res{16, 16, 16};
+  if (p.isOptSet("g")) {
+    grid_res = glm::uvec3{p.getOptsInt("g")[0], p.getOptsInt("g")[1], p.getOptsInt("g")[2]};
+  }
+
+  std::vector<std::string> args{p.getArgs()}; 
+
+  std::string file_name{args[0]};
+  std::string ext(file_name.substr(file_name.find_last_of(".") + 1));
+  if (file_name.empty() || ext != "ks") {
+    throw std::invalid_argument{"No .ks file specified"};
+    exit(EXIT_FAILURE);
+  }
+
+  std::vector<std::string> calib_filenames;
+  std::string resource_path = file_name.substr(0, file_name.find_last_of("/\\")) + '/';
+  std::ifstream in(file_name);
+  std::string token;
+  while(in >> token){
+    if (token == "kinect") {
+      in >> token;
+      // detect absolute path
+      if (token[0] == '/' || token[1] == ':') {
+        calib_filenames.push_back(token);
+      }
+      else {
+        calib_filenames.push_back(resource_path + token);
+      }
+    }
+  }
+  in.close();
+
+  std::cout << "using grid resolution " << grid_res.x << ", " << grid_res.y << ", " << grid_res.z << std::endl;
+  #pragma omp parallel for
+  for(int i = 0; i < int(calib_filenames.size()); ++i) {
+    std::string basefile = calib_filenames[i];
+    basefile.replace( basefile.end() - 3, basefile.end(), "");
+    fitVolume<kinect::xyz>(basefile + "cv_xyz", grid_res, " m").write(basefile + "cv_xyz_model");
+    fitVolume<kinect::uv>(basefile + "cv_uv", grid_res, "").write(basefile + "cv_uv_model");
+  }
+
+  return EXIT_SUCCESS;
+}
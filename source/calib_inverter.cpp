@@ -12,6 +12,7 @@ float default_voxel_size = 0.007f;
 int main(int argc, char *argv[]) {
   CMDParser p("ks_file");
   p.addOpt("s",1,"voxel_size", "set size of voxel in m (default 0.007)");
+  p.addOpt("n",1,"newton_iterations", "refine inverse with newton iterations (default 0), allows coarser voxels");
 
   p.init(argc,argv);
 
@@ -19,6 +20,10 @@ int main(int argc, char *argv[]) {
   if (p.isOptSet("s")) {
     voxel_size = p.getOptsFloat("s")[0];
   }
+  unsigned newton_iterations = 0;
+  if (p.isOptSet("n")) {
+    newton_iterations = p.getOptsInt("n")[0];
+  }
   
   std::vector<std::string> args{p.getArgs()}; 
 
@@ -68,7 +73,7 @@ int main(int argc, char *argv[]) {
   g_inv = std::unique_ptr<kinect::CalibrationInverter>{new kinect::CalibrationInverter(calib_filenames, g_bbox)};
 
   std::cout << "using resolution " << volume_res.x << ", " << volume_res.y << ", " << volume_res.z << std::endl;
-  g_inv->calculateInverseVolumes(volume_res);
+  g_inv->calculateInverseVolumes(volume_res, newton_iterations);
   g_inv->writeInverseVolumes(resource_path);
 
   return EXIT_SUCCESS;
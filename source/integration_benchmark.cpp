@@ -0,0 +1,153 @@
+#include "cpu_integrator.hpp"
+#include "calibration_files.hpp"
+#include <KinectCalibrationFile.h>
+#include "validity_volume.hpp"
+#include "BoundingBox.h"
+#include "CMDParser.h"
+#include <Timer.h>
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+float default_voxel_size = 0.007f;
+// truncation distance of ReconIntegration
+float limit = 0.01f;
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[]) {
+  CMDParser p("ks_file");
+  p.addOpt("s",1,"voxel_size", "set size of voxel in m (default 0.007)");
+  p.addOpt("n",1,"iterations", "number of timed integrations per run (default 10)");
+
+  p.init(argc,argv);
+
+  float voxel_size = default_voxel_size;
+  if (p.isOptSet("s")) {
+    voxel_size = p.getOptsFloat("s")[0];
+  }
+  unsigned iterations = 10;
+  if (p.isOptSet("n")) {
+    iterations = p.getOptsInt("n")[0];
+  }
+
+  std::vector<std::string> args{p.getArgs()};
+
+  std::string file_name{args[0]};
+  std::string ext(file_name.substr(file_name.find_last_of(".") + 1));
+  if (file_name.empty() || ext != "ks") {
+    throw std::invalid_argument{"No .ks file specified"};
+  }
+
+  std::vector<std::string> calib_filenames;
+  gloost::Point3 bbox_min{0.0f, 0.0f, 0.0f};
+  gloost::Point3 bbox_max{0.0f, 0.0f, 0.0f};
+
+  std::string resource_path = file_name.substr(0, file_name.find_last_of("/\\")) + '/';
+  std::ifstream in(file_name);
+  std::string token;
+  while(in >> token){
+    if (token == "kinect") {
+      in >> token;
+      // detect absolute path
+      if (token[0] == '/' || token[1] == ':') {
+        calib_filenames.push_back(token);
+      }
+      else {
+        calib_filenames.push_back(resource_path + token);
+      }
+    }
+    else if (token == "bbx") {
+      in >> bbox_min[0];
+      in >> bbox_min[1];
+      in >> bbox_min[2];
+      in >> bbox_max[0];
+      in >> bbox_max[1];
+      in >> bbox_max[2];
+    }
+  }
+  in.close();
+
+  glm::fvec3 bbox_dimensions = glm::fvec3{bbox_max[0] - bbox_min[0],
+                                          bbox_max[1] - bbox_min[1],
+                                          bbox_max[2] - bbox_min[2]};
+  glm::uvec3 volume_res{glm::ceil(bbox_dimensions / voxel_size)};
+
+  kinect::CalibrationFiles cfs{calib_filenames};
+  glm::uvec2 res_depth{cfs.getWidth(), cfs.getHeight()};
+
+  std::vector<kinect::CalibrationVolume<glm::fvec4>> volumes_inv;
+  for(auto const& calib_file : calib_filenames) {
+    std::string basefile = calib_file;
+    basefile.replace(basefile.end() - 3, basefile.end(), "");
+    volumes_inv.emplace_back(basefile + "cv_xyz_inv");
+  }
+  glm::uvec3 res_inv{volumes_inv[0].res()};
+  // masks are written by calib_inverter, missing or stale ones are not used
+  kinect::CalibrationVolume<std::uint8_t> volume_valid{};
+  gloost::BoundingBox bbox{bbox_min, bbox_max};
+  if (!kinect::readValidityVolume(resource_path + "cv_valid", bbox, volumes_inv.size(), res_inv, volume_valid)) {
+    std::cout << "no validity volume, treating all voxels as visible" << std::endl;
+    std::vector<std::uint8_t> all(res_inv.x * res_inv.y * res_inv.z, kinect::allCameras(volumes_inv.size()));
+    volume_valid = kinect::CalibrationVolume<std::uint8_t>{res_inv, volumes_inv[0].depthLimits(), all};
+  }
+
+  // flat frames in the middle of the depth range, every voxel near it is integrated
+  // depths are normalized to the calibrated range like the filtered depth textures
+  std::vector<std::vector<float>> depths;
+  std::vector<std::vector<float>> qualities;
+  for(std::size_t i = 0; i < volumes_inv.size(); ++i) {
+    float depth = 0.5f;
+    depths.emplace_back(res_depth.x * res_depth.y, depth);
+    qualities.emplace_back(res_depth.x * res_depth.y, 1.0f);
+  }
+
+  kinect::CpuIntegrator integrator{volumes_inv, volume_valid, volume_res, limit};
+  std::size_t num_voxels = std::size_t(volume_res.x) * volume_res.y * volume_res.z;
+  std::cout << "integrating " << volume_res.x << ", " << volume_res.y << ", " << volume_res.z
+            << " voxels from " << volumes_inv.size() << " cameras" << std::endl;
+
+  int max_threads = omp_get_max_threads();
+  for(int threads : {1, max_threads}) {
+    omp_set_num_threads(threads);
+    // warm up caches and thread pool
+    integrator.integrate(depths, qualities, res_depth);
+    sensor::Timer timer{};
+    timer.start();
+    for(unsigned i = 0; i < iterations; ++i) {
+      integrator.integrate(depths, qualities, res_depth);
+    }
+    timer.stop();
+    double seconds = timer.get().msec() / 1000.0 / iterations;
+    double voxels_per_second = num_voxels / seconds;
+    std::cout << threads << " threads: " << seconds * 1000.0 << " ms per frame, "
+              << voxels_per_second / 1e6 << " MVoxel/s, "
+              << voxels_per_second / threads / 1e6 << " MVoxel/s per core" << std::endl;
+    if (threads == max_threads) {
+      break;
+    }
+  }
+
+  // the timed path must match the reference and actually reach the band
+  std::vector<float> reference{integrator.integrateReference(depths, qualities, res_depth)};
+  std::vector<float> const& tsdf = integrator.tsdf();
+  float max_error = 0.0f;
+  std::size_t num_band = 0;
+  for(std::size_t i = 0; i < tsdf.size(); ++i) {
+    max_error = std::max(max_error, std::abs(tsdf[i] - reference[i]));
+    if (std::abs(reference[i]) < limit) {
+      ++num_band;
+    }
+  }
+  std::cout << num_band << " voxels (" << 100.0f * num_band / num_voxels << " %) inside the truncation band, "
+            << "max difference to the reference " << max_error << std::endl;
+  if (num_band == 0 || max_error > limit * 1e-3f) {
+    std::cerr << "cpu integration does not match the reference" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
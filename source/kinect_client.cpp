@@ -12,6 +12,8 @@
 #include <glbinding/callbacks.h>
 using namespace gl;
 #include <GL/glut.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
 #include <cmath>
@@ -34,6 +36,7 @@ using namespace gl;
 #include "reconstruction.hpp"
 #include "recon_trigrid.hpp"
 #include "recon_points.hpp"
+#include "recon_splat.hpp"
 #include "recon_calibs.hpp"
 #include "recon_integration.hpp"
 
@@ -55,7 +58,11 @@ bool     g_draw_calibvis= false;
 bool     g_draw_textures= false;
 unsigned g_texture_type = 0;
 unsigned g_num_texture  = 0;
+// side by side stereo, eye separation in m
+bool     g_stereo       = false;
+float    g_eye_distance = 0.064f;
 gloost::BoundingBox     g_bbox{};
+kinect::VolumeEncoding  g_cv_encoding = kinect::VolumeEncoding::FLOAT;
 
 gloost::PerspectiveCamera g_camera{50.0, g_aspect, 0.1, 200.0};
 mvt::FourTiledWindow g_ftw{g_screenWidth, g_screenHeight};
@@ -69,6 +76,7 @@ std::unique_ptr<kinect::CalibrationFiles> g_calib_files;
 void init(std::vector<std::string>& args);
 void update_view_matrix();
 void draw3d();
+void draw_stereo(kinect::ReconTrigrid& trigrid);
 void resize(int width, int height);
 void key(unsigned char key, int x, int y);
 void motionFunc(int mouse_h, int mouse_v);
@@ -139,7 +147,7 @@ void init(std::vector<std::string> args){
   g_bbox.setPMax(bbox_max);
 
   g_calib_files = std::unique_ptr<kinect::CalibrationFiles>{new kinect::CalibrationFiles(calib_filenames)};
-  g_cv = std::unique_ptr<kinect::CalibVolumes>{new kinect::CalibVolumes(calib_filenames, g_bbox)};
+  g_cv = std::unique_ptr<kinect::CalibVolumes>{new kinect::CalibVolumes(*g_calib_files, g_bbox, g_cv_encoding)};
   g_nka = std::unique_ptr<kinect::NetKinectArray>{new kinect::NetKinectArray(serverport, g_calib_files.get(), g_cv.get())};
   
   // binds to unit 1 to 3
@@ -148,10 +156,21 @@ void init(std::vector<std::string> args){
   g_cv->setStartTextureUnit(5);
   g_cv->loadInverseCalibs(resource_path);
   g_cv->setStartTextureUnitInv(30);
+  g_cv->setStartTextureUnitGrid(50);
 
   g_recons.emplace_back(new kinect::ReconTrigrid(*g_calib_files, g_cv.get(), g_bbox));
   g_recons.emplace_back(new kinect::ReconPoints(*g_calib_files, g_cv.get(), g_bbox));
   g_recons.emplace_back(new kinect::ReconIntegration(*g_calib_files, g_cv.get(), g_bbox));
+  g_recons.emplace_back(new kinect::ReconIntegration(*g_calib_files, g_cv.get(), g_bbox, true));
+  // three levels, finest in the center between the sensors
+  g_recons.emplace_back(new kinect::ReconIntegration(*g_calib_files, g_cv.get(), g_bbox, false, 3));
+  // same points as mode 1, timings of both are shown with the info overlay
+  g_recons.emplace_back(new kinect::ReconSplat(*g_calib_files, g_cv.get(), g_bbox));
+  for (auto& recon : g_recons) {
+    if (auto integration = dynamic_cast<kinect::ReconIntegration*>(recon.get())) {
+      integration->setRaymarchStats(g_info);
+    }
+  }
 
   g_calibvis = std::unique_ptr<kinect::ReconCalibs>(new kinect::ReconCalibs(*g_calib_files, g_cv.get(), g_bbox));
 
@@ -232,9 +251,31 @@ void draw3d(void)
     g_nka->update();
   }
   // draw active reconstruction
-  g_recons.at(g_recon_mode)->draw();
+  auto trigrid = dynamic_cast<kinect::ReconTrigrid*>(g_recons.at(g_recon_mode).get());
+  if (g_stereo && trigrid) {
+    draw_stereo(*trigrid);
+  }
+  else {
+    g_recons.at(g_recon_mode)->draw();
+  }
 
   g_stats->stopGPU();
+  if(g_info) {
+    std::string stages{};
+    for(auto const& stage : g_nka->getStageTimes()) {
+      stages += stage.first + ": " + gloost::toString(stage.second) + " ms  ";
+    }
+    for(auto const& stage : g_recons.at(g_recon_mode)->getStageTimes()) {
+      stages += stage.first + ": " + gloost::toString(stage.second) + " ms  ";
+    }
+    if (auto integration = dynamic_cast<kinect::ReconIntegration*>(g_recons.at(g_recon_mode).get())) {
+      stages += "samples per ray: " + gloost::toString(integration->getSamplesPerRay());
+    }
+    if (auto points = dynamic_cast<kinect::ReconPoints*>(g_recons.at(g_recon_mode).get())) {
+      stages += "points: " + gloost::toString(points->getNumPoints());
+    }
+    g_stats->setInfoSlot(stages.c_str(), 2);
+  }
   //std::cerr << "after stopGPU" << std::endl; check_gl_errors("after stopGPU", false);
 
   if(g_picking){
@@ -285,6 +326,28 @@ void draw3d(void)
   }
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////
+  /// both eyes in one pass, left half of the window for the left eye
+void draw_stereo(kinect::ReconTrigrid& trigrid) {
+  glm::fmat4 modelview{};
+  glm::fmat4 projection{};
+  glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(modelview));
+  glGetFloatv(GL_PROJECTION_MATRIX, glm::value_ptr(projection));
+  // keep the vertical field of view in the half width viewports
+  projection = glm::scale(glm::fmat4{}, glm::fvec3{2.0f, 1.0f, 1.0f}) * projection;
+
+  std::vector<kinect::ReconTrigrid::View> views{};
+  for(unsigned i = 0; i < 2; ++i) {
+    kinect::ReconTrigrid::View view{};
+    float offset = (i == 0 ? 0.5f : -0.5f) * g_eye_distance;
+    view.modelview = glm::translate(glm::fmat4{}, glm::fvec3{offset, 0.0f, 0.0f}) * modelview;
+    view.projection = projection;
+    view.viewport = glm::uvec4{i * (g_screenWidth / 2), 0, g_screenWidth / 2, g_screenHeight};
+    views.push_back(view);
+  }
+  trigrid.drawViews(views);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
   /// this function is triggered when the screen is resized
 
@@ -323,6 +386,21 @@ void key(unsigned char key, int x, int y)
   case 'f':
     g_draw_frustums = !g_draw_frustums;
     break;
+  case 'B':
+    g_nka->setSeparableFilter(!g_nka->isSeparableFilter());
+    std::cout << "depth filter " << (g_nka->isSeparableFilter() ? "separable" : "full bilateral") << std::endl;
+    break;
+  case 'E':
+  {
+    kinect::FilterError error{g_nka->measureFilterError()};
+    std::cout << "separable filter error - mean: " << error.mean_depth * 1000.0f << " mm, max: " << error.max_depth * 1000.0f
+              << " mm, quality: " << error.mean_quality << ", validity mismatch: " << error.mismatch_ratio * 100.0f << " %" << std::endl;
+    break;
+  }
+  case 'F':
+    g_nka->setComputeProcessing(!g_nka->isComputeProcessing());
+    std::cout << "depth processing with " << (g_nka->isComputeProcessing() ? "compute" : "fragment") << " shader" << std::endl;
+    break;
   case 'b':
     g_bilateral = !g_bilateral;
     g_nka->filterTextures(g_bilateral);
@@ -366,6 +444,83 @@ void key(unsigned char key, int x, int y)
     num_kinect = (num_kinect+ 1) % g_calib_files->num();
     g_calibvis->setActiveKinect(num_kinect);
     break;
+  case 'l':
+    g_cv->setAnalytic(!g_cv->isAnalytic());
+    std::cout << "calibration " << (g_cv->isAnalytic() ? "models" : "volumes") << std::endl;
+    break;
+  case 'i':
+    if (auto integration = dynamic_cast<kinect::ReconIntegration*>(g_recons.at(g_recon_mode).get())) {
+      integration->setComputeIntegration(!integration->isComputeIntegration());
+      std::cout << "integration with " << (integration->isComputeIntegration() ? "compute" : "vertex") << " shader" << std::endl;
+    }
+    break;
+  case 'k':
+    if (auto integration = dynamic_cast<kinect::ReconIntegration*>(g_recons.at(g_recon_mode).get())) {
+      integration->setEmptySkipping(!integration->isEmptySkipping());
+      std::cout << "empty space skipping " << (integration->isEmptySkipping() ? "on" : "off") << std::endl;
+    }
+    break;
+  case 'j':
+    if (auto integration = dynamic_cast<kinect::ReconIntegration*>(g_recons.at(g_recon_mode).get())) {
+      // counts of the last frame, toggling back and forth compares both modes on the same view
+      if (integration->isStepImage()) {
+        glm::fvec2 steps{integration->readStepCounts()};
+        std::cout << (integration->isAdaptiveSteps() ? "adaptive" : "fixed") << " steps, samples per pixel mean: "
+                  << steps.x << " max: " << steps.y << std::endl;
+      }
+      integration->setAdaptiveSteps(!integration->isAdaptiveSteps());
+      std::cout << "adaptive raymarching steps " << (integration->isAdaptiveSteps() ? "on" : "off") << std::endl;
+    }
+    break;
+  case 'n':
+    // print the counts of the last frame when stopping
+    if (auto integration = dynamic_cast<kinect::ReconIntegration*>(g_recons.at(g_recon_mode).get())) {
+      if (integration->isStepImage()) {
+        glm::fvec2 steps{integration->readStepCounts()};
+        std::cout << "raymarching samples per pixel, mean: " << steps.x << " max: " << steps.y << std::endl;
+      }
+      integration->setStepImage(!integration->isStepImage());
+    }
+    break;
+  case 'o':
+    if (auto integration = dynamic_cast<kinect::ReconIntegration*>(g_recons.at(g_recon_mode).get())) {
+      integration->setPrecomputedShading(!integration->isPrecomputedShading());
+      std::cout << "shading from " << (integration->isPrecomputedShading() ? "integrated volumes" : "per pixel blending") << std::endl;
+    }
+    break;
+  case 'x':
+    if (auto integration = dynamic_cast<kinect::ReconIntegration*>(g_recons.at(g_recon_mode).get())) {
+      try {
+        kinect::writePly(integration->extractMesh(), "mesh.ply");
+        std::cout << "wrote mesh.ply" << std::endl;
+      }
+      catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+      }
+    }
+    break;
+  case 'h':
+    if (auto integration = dynamic_cast<kinect::ReconIntegration*>(g_recons.at(g_recon_mode).get())) {
+      integration->setTemporalFusion(!integration->isTemporalFusion());
+      std::cout << "temporal fusion " << (integration->isTemporalFusion() ? "on" : "off") << std::endl;
+    }
+    break;
+  case 'd':
+    g_stereo = !g_stereo;
+    std::cout << "trigrid stereo " << (g_stereo ? "on" : "off") << std::endl;
+    break;
+  case 'z':
+    if (auto points = dynamic_cast<kinect::ReconPoints*>(g_recons.at(g_recon_mode).get())) {
+      points->setLod(!points->isLod());
+      std::cout << "point lod " << (points->isLod() ? "on" : "off") << std::endl;
+    }
+    break;
+  case 'e':
+    if (auto trigrid = dynamic_cast<kinect::ReconTrigrid*>(g_recons.at(g_recon_mode).get())) {
+      trigrid->setBackfaceCulling(!trigrid->isBackfaceCulling());
+      std::cout << "trigrid back-facing tile culling " << (trigrid->isBackfaceCulling() ? "on" : "off") << std::endl;
+    }
+    break;
   case '#':
     for(unsigned i = 0; i < g_calib_files->num(); ++i){
       g_nka->depth_compression_lex = !g_nka->depth_compression_lex;
@@ -448,6 +603,7 @@ int main(int argc, char *argv[]) {
 
   p.addOpt("r",2,"resolution", "set screen resolution");
   p.addOpt("i",-1,"info", "draw info");
+  p.addOpt("e",1,"encoding", "calibration volume encoding, 0: float, 1: half residual, 2: unorm16 residual");
   p.init(argc,argv);
 
   if(p.isOptSet("r")){
@@ -459,6 +615,16 @@ int main(int argc, char *argv[]) {
     g_info = true;
   }
 
+  if(p.isOptSet("e")){
+    int encoding = p.getOptsInt("e")[0];
+    if (encoding == 1) {
+      g_cv_encoding = kinect::VolumeEncoding::HALF;
+    }
+    else if (encoding == 2) {
+      g_cv_encoding = kinect::VolumeEncoding::UNORM16;
+    }
+  }
+
   glutInit(&argc, argv);
   glutInitWindowSize(g_screenWidth, g_screenHeight);
   glutInitWindowPosition(10,10);